@@ -0,0 +1,408 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/cpu.h"
+#include "../src/machine.h"
+#include "../src/cpm.h"
+#include "../src/clock.h"
+#include "../src/filter.h"
+#include "../src/perf.h"
+
+extern const int WIDTH;
+extern const int HEIGHT;
+extern const int SCALE;
+
+#define CPUDIAG_RUNS 20000
+#define ATTRACT_FRAMES 3000
+#define SESSION_FRAMES 3000
+
+struct Result {
+	char name[32];
+	uint64_t instructions;
+	uint64_t cycles;
+	uint64_t frames;
+	double seconds; // in the emulate loop alone
+	double render_ns; // per frame
+	double filter_ns; // per frame, 4x with every effect
+	struct PerfCount emulate; // host counters over emulate(), none if unavailable
+	struct PerfCount draw; // and machine_draw_surface()
+};
+
+static int perf_missing;
+
+static void
+perf_begin(struct Perf *p) {
+	if (perf_open(p) && !perf_missing) {
+		fprintf(stderr, "hardware counters unavailable (no pmu, or perf_event_paranoid), timing only\n");
+		perf_missing = 1;
+	}
+}
+
+static void
+perf_end(struct Perf *p, struct PerfCount *c) {
+	perf_read(p, c);
+	perf_close(p);
+}
+
+// host events of the emulate() loop per emulated instruction, negative without a counter
+static double
+per_instruction(const struct Result *r, enum PERF_EVENT e) {
+	if (!(r->emulate.have & 1u << e) || r->instructions == 0)
+		return -1;
+	return (double)r->emulate.value[e] / r->instructions;
+}
+
+static double
+mhz(const struct Result *r) {
+	return r->cycles / r->seconds / 1e6;
+}
+
+static double
+ips(const struct Result *r) {
+	return r->instructions / r->seconds;
+}
+
+static double
+fps(const struct Result *r) {
+	return r->frames / r->seconds;
+}
+
+/*
+ * cpudiag.bin start to finish, CPUDIAG_RUNS times. a first run untimed
+ * finds the pages it writes, so restarts only copy those back.
+ */
+static int
+bench_cpudiag(struct Result *r) {
+	struct CPM cpm;
+
+	strcpy(r->name, "cpudiag");
+	if (cpm_init(&cpm, "cpudiag.bin"))
+		return 1;
+	cpm.image[368] = 0x7; // stack at 0x7ad, like tests/emulator.c
+
+	cpm_restart(&cpm);
+	while (!cpm.done)
+		cpm_step(&cpm);
+	cpm_restore_changed(&cpm);
+
+	struct Perf perf;
+	perf_begin(&perf);
+	perf_start(&perf);
+	uint64_t start = clock_ns();
+	for (int i = 0; i < CPUDIAG_RUNS; i++) {
+		cpm_restart(&cpm);
+		while (!cpm.done) {
+			r->cycles += cpm_step(&cpm);
+			r->instructions++;
+		}
+	}
+	r->seconds = (clock_ns() - start) / 1e9;
+	perf_stop(&perf);
+	perf_end(&perf, &r->emulate);
+	cpm_free(&cpm);
+	return 0;
+}
+
+/*
+ * frames from power on, with port 1 taken from session if given. with
+ * emulate and draw it counts those two on the hardware counters and
+ * times nothing, otherwise it adds up the ns spent emulating, drawing and
+ * filtering and fills in r's instructions and cycles.
+ */
+static int
+run_frames(char *rom, const uint8_t *session, int frames, struct Filter *filter, uint32_t *scaled,
+		struct Perf *emulate, struct Perf *draw, uint64_t ns[3], struct Result *r) {
+	struct Machine cabinet = {0};
+
+	if (machine_init(&cabinet, rom))
+		return 1;
+	cabinet.framebuffer = calloc(WIDTH * SCALE * HEIGHT * SCALE, sizeof(uint32_t));
+
+	for (int i = 0; i < frames; i++) {
+		if (session)
+			cabinet.iports[1] = session[i];
+		if (emulate) {
+			perf_start(emulate);
+			machine_frame(&cabinet);
+			perf_stop(emulate);
+			perf_start(draw);
+			machine_draw_surface(&cabinet);
+			perf_stop(draw);
+			continue;
+		}
+
+		uint64_t t = clock_ns();
+		machine_frame(&cabinet);
+		ns[0] += clock_ns() - t;
+
+		t = clock_ns();
+		machine_draw_surface(&cabinet);
+		ns[1] += clock_ns() - t;
+
+		t = clock_ns();
+		filter_run(filter, &cabinet.cpu->ram[0x2400], scaled, FILTER_WIDTH * 4);
+		ns[2] += clock_ns() - t;
+	}
+
+	if (r) {
+		r->instructions = cabinet.instructions;
+		r->cycles = cabinet.cycles;
+	}
+	free(cabinet.framebuffer);
+	free(cabinet.cpu->ram);
+	free(cabinet.cpu);
+	return 0;
+}
+
+/*
+ * runs frames from power on drawing every frame into a scaled
+ * framebuffer like main() used to, and through the filters at 4x with
+ * all of them on. only machine_frame() counts towards seconds, drawing
+ * and filtering are timed apart. where there are hardware counters the
+ * same frames run again to count emulating and drawing, so their ioctls
+ * stay out of the timed run.
+ */
+static int
+bench_frames(struct Result *r, const char *name, char *rom, const uint8_t *session, int frames) {
+	static struct Filter filter;
+	struct FilterConfig config = { .scale = 4, .smooth = 1, .scanlines = 60, .persistence = 160, .gel = 1 };
+	uint64_t ns[3] = {0};
+
+	strcpy(r->name, name);
+	uint32_t *scaled = calloc(FILTER_WIDTH * 4 * FILTER_HEIGHT * 4, sizeof(uint32_t));
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	filter_init(&filter, &config, cpus);
+	int failed = run_frames(rom, session, frames, &filter, scaled, NULL, NULL, ns, r);
+	filter_free(&filter);
+	free(scaled);
+	if (failed)
+		return 1;
+
+	r->seconds = ns[0] / 1e9;
+	r->frames = frames;
+	r->render_ns = (double)ns[1] / frames;
+	r->filter_ns = (double)ns[2] / frames;
+
+	struct Perf emulate, draw;
+	perf_begin(&emulate);
+	perf_begin(&draw);
+	if (emulate.leader >= 0 || draw.leader >= 0)
+		run_frames(rom, session, frames, NULL, NULL, &emulate, &draw, NULL, NULL);
+	perf_end(&emulate, &r->emulate);
+	perf_end(&draw, &r->draw);
+	return 0;
+}
+
+/*
+ * a session is one byte per frame, the value of input port 1. without a
+ * recording a fixed script inserts a coin, starts and then moves and
+ * fires pseudo randomly.
+ */
+static uint8_t *
+session_load(const char *path, int *frames) {
+	uint8_t *session = calloc(SESSION_FRAMES, 1);
+
+	if (path) {
+		FILE *f = fopen(path, "rb");
+		if (f == NULL) {
+			perror(path);
+			exit(1);
+		}
+		*frames = fread(session, 1, SESSION_FRAMES, f);
+		fclose(f);
+		if (*frames == 0) {
+			fprintf(stderr, "%s: no frames in session\n", path);
+			exit(1);
+		}
+		return session;
+	}
+
+	uint32_t seed = 1;
+	for (int i = 0; i < SESSION_FRAMES; i++) {
+		seed = seed * 1103515245 + 12345;
+		if (i >= 120 && i < 128)
+			session[i] = 0x01; // coin
+		else if (i >= 200 && i < 208)
+			session[i] = 0x04; // 1p start
+		else if (i >= 300)
+			session[i] = (seed >> 16) & 0x70; // fire, left, right
+	}
+	*frames = SESSION_FRAMES;
+	return session;
+}
+
+// the counters that were available, as a json object
+static void
+write_counts(FILE *f, const char *name, const struct PerfCount *c) {
+	fprintf(f, "\"%s\": {", name);
+	for (int e = 0, n = 0; e < PERF_EVENTS; e++) {
+		if (c->have & 1u << e)
+			fprintf(f, "%s\"%s\": %llu", n++ ? ", " : "", perf_names[e], (unsigned long long)c->value[e]);
+	}
+	fprintf(f, "}");
+}
+
+static void
+write_json(FILE *f, const struct Result *results, int n) {
+	fprintf(f, "{\"timing\": \"emulate\", \"workloads\": [\n");
+	for (int i = 0; i < n; i++) {
+		const struct Result *r = &results[i];
+		fprintf(f, "{\"name\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, \"frames\": %llu, "
+			"\"seconds\": %.6f, \"mhz\": %.3f, \"ips\": %.0f, \"fps\": %.2f, \"render_ns\": %.0f, \"filter_ns\": %.0f",
+			r->name, (unsigned long long)r->instructions, (unsigned long long)r->cycles,
+			(unsigned long long)r->frames, r->seconds, mhz(r), ips(r), fps(r), r->render_ns, r->filter_ns);
+		if (r->emulate.have | r->draw.have) {
+			if (per_instruction(r, PERF_CYCLES) >= 0)
+				fprintf(f, ", \"host_cycles_per_instruction\": %.3f", per_instruction(r, PERF_CYCLES));
+			if (per_instruction(r, PERF_BRANCH_MISSES) >= 0)
+				fprintf(f, ", \"branch_misses_per_instruction\": %.5f", per_instruction(r, PERF_BRANCH_MISSES));
+			fprintf(f, ", \"perf\": {");
+			write_counts(f, "emulate", &r->emulate);
+			if (r->frames) {
+				fprintf(f, ", ");
+				write_counts(f, "draw", &r->draw);
+			}
+			fprintf(f, "}");
+		}
+		fprintf(f, "}%s\n", i + 1 < n ? "," : "");
+	}
+	fprintf(f, "]}\n");
+}
+
+static int
+regressed(const char *name, const char *metric, double base, double now, int higher, double threshold) {
+	double change = base ? (now - base) / base * 100 : 0;
+	int bad = higher ? change < -threshold : change > threshold;
+
+	fprintf(stderr, "%-10s %-10s %14.2f %14.2f %+7.1f%%%s\n",
+		name, metric, base, now, change, bad ? "  REGRESSION" : "");
+	return bad;
+}
+
+/*
+ * compares against a json file written by an earlier run, one workload per
+ * line as write_json() puts it. returns the number of regressions. a
+ * baseline without "timing": "emulate" timed drawing and filtering along
+ * with the frames, so only its per frame times are comparable.
+ */
+static int
+compare(const char *path, const struct Result *results, int n, double threshold) {
+	FILE *f = fopen(path, "r");
+	char line[1024];
+	int bad = 0;
+
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+
+	int rates = fgets(line, sizeof(line), f) && strstr(line, "\"timing\": \"emulate\"");
+	if (!rates)
+		fprintf(stderr, "%s timed more than the emulate loop, leaving out mhz, ips and fps\n", path);
+
+	fprintf(stderr, "%-10s %-10s %14s %14s %8s\n", "workload", "metric", "baseline", "now", "change");
+	while (fgets(line, sizeof(line), f)) {
+		char name[32];
+		double seconds, base_mhz, base_ips, base_fps, base_render, base_filter;
+		unsigned long long instructions, cycles, frames;
+
+		if (sscanf(line, "{\"name\": \"%31[^\"]\", \"instructions\": %llu, \"cycles\": %llu, \"frames\": %llu, "
+				"\"seconds\": %lf, \"mhz\": %lf, \"ips\": %lf, \"fps\": %lf, \"render_ns\": %lf",
+				name, &instructions, &cycles, &frames, &seconds,
+				&base_mhz, &base_ips, &base_fps, &base_render) != 9)
+			continue;
+
+		for (int i = 0; i < n; i++) {
+			const struct Result *r = &results[i];
+			if (strcmp(r->name, name) || r->seconds == 0)
+				continue;
+			if (rates) {
+				bad += regressed(name, "mhz", base_mhz, mhz(r), 1, threshold);
+				bad += regressed(name, "ips", base_ips, ips(r), 1, threshold);
+			}
+			if (r->frames) {
+				if (rates)
+					bad += regressed(name, "fps", base_fps, fps(r), 1, threshold);
+				bad += regressed(name, "render_ns", base_render, r->render_ns, 0, threshold);
+				char *filter = strstr(line, "\"filter_ns\": ");
+				if (filter && sscanf(filter, "\"filter_ns\": %lf", &base_filter) == 1)
+					bad += regressed(name, "filter_ns", base_filter, r->filter_ns, 0, threshold);
+			}
+			// host cycles per instruction, where both runs had the counter
+			char *cpi = strstr(line, "\"host_cycles_per_instruction\": ");
+			double base_cpi;
+			if (cpi && per_instruction(r, PERF_CYCLES) >= 0 &&
+					sscanf(cpi, "\"host_cycles_per_instruction\": %lf", &base_cpi) == 1)
+				bad += regressed(name, "host_cpi", base_cpi, per_instruction(r, PERF_CYCLES), 0, threshold);
+		}
+	}
+
+	fclose(f);
+	return bad;
+}
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-o results.json] [-b baseline.json] [-t percent] [-r session] [rom]\n", name);
+	exit(1);
+}
+
+int
+main(int argc, char **argv) {
+	char *output = NULL;
+	char *baseline = NULL;
+	char *replay = NULL;
+	double threshold = 5;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:b:t:r:")) != -1) {
+		switch (opt) {
+			case 'o': output = optarg; break;
+			case 'b': baseline = optarg; break;
+			case 't': threshold = atof(optarg); break;
+			case 'r': replay = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+	char *rom = optind < argc ? argv[optind] : "space-invaders.rom";
+
+	struct Result results[3] = {0};
+	int n = 0;
+
+	if (bench_cpudiag(&results[n]) == 0)
+		n++;
+	else
+		fprintf(stderr, "skipping the cpudiag workload\n");
+
+	if (access(rom, R_OK) == 0) {
+		int frames;
+		uint8_t *session = session_load(replay, &frames);
+
+		if (bench_frames(&results[n], "attract", rom, NULL, ATTRACT_FRAMES) == 0)
+			n++;
+		if (bench_frames(&results[n], "session", rom, session, frames) == 0)
+			n++;
+		free(session);
+	} else {
+		fprintf(stderr, "%s not found, skipping the attract and session workloads\n", rom);
+	}
+
+	FILE *f = output ? fopen(output, "w") : stdout;
+	if (f == NULL) {
+		perror(output);
+		return 1;
+	}
+	write_json(f, results, n);
+	if (output)
+		fclose(f);
+
+	if (baseline && compare(baseline, results, n, threshold)) {
+		fprintf(stderr, "performance regressed against %s\n", baseline);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,215 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/cpu.h"
+#include "../src/machine.h"
+#include "../src/objects.h"
+#include "../src/invaders.h"
+#include "../src/snapshot.h"
+#include "../src/state.h"
+#include "../src/clock.h"
+
+#define CLONES 1000000
+#define WIDTH 16
+#define DEPTH 60
+
+struct Node {
+	struct State *state;
+	int score;
+	uint32_t key; // random tie break
+};
+
+// the same search with a full snapshot per node
+struct CopyNode {
+	struct Snapshot *snap;
+	int score;
+	uint32_t key;
+};
+
+static uint32_t seed;
+
+static uint32_t
+rnd(void) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static int
+by_score(const void *x, const void *y) {
+	const struct Node *a = x;
+	const struct Node *b = y;
+	if (a->score != b->score)
+		return b->score - a->score;
+	return a->key < b->key ? -1 : a->key > b->key;
+}
+
+static int
+by_copy_score(const void *x, const void *y) {
+	const struct CopyNode *a = x;
+	const struct CopyNode *b = y;
+	if (a->score != b->score)
+		return b->score - a->score;
+	return a->key < b->key ? -1 : a->key > b->key;
+}
+
+static int
+score(struct Machine *machine) {
+	struct Objects objects;
+	objects_decode(machine->cpu->ram, &objects);
+	return objects.score[0] * 16 + objects.ships * 1000;
+}
+
+static int
+popcount(const uint32_t *bits, int n) {
+	int count = 0;
+	for (int i = 0; i < n; i++)
+		for (uint32_t x = bits[i]; x; x &= x - 1)
+			count++;
+	return count;
+}
+
+/*
+ * beam search over one frame per level, keeping the WIDTH best children.
+ * every node is a load of its parent, a frame and a capture.
+ */
+static void
+beam(struct Workspace *ws, struct State *root) {
+	struct Node beam[WIDTH] = {0};
+	struct Node children[WIDTH * ACTIONS];
+	int n = 1;
+	long nodes = 0;
+	long pages = 0;
+
+	seed = 1;
+	beam[0].state = state_clone(root);
+	uint64_t start = clock_ns();
+
+	for (int depth = 0; depth < DEPTH; depth++) {
+		int m = 0;
+		for (int i = 0; i < n; i++) {
+			for (int a = 0; a < ACTIONS; a++) {
+				state_load(ws, beam[i].state);
+				ws->machine->iports[1] = invaders_buttons[a];
+				machine_frame(ws->machine);
+				pages += popcount(ws->machine->cpu->dirty, 8);
+
+				children[m].state = state_capture(ws);
+				children[m].score = score(ws->machine);
+				children[m].key = rnd();
+				m++;
+			}
+			state_free(beam[i].state);
+		}
+
+		qsort(children, m, sizeof(children[0]), by_score);
+		n = m < WIDTH ? m : WIDTH;
+		for (int i = 0; i < m; i++) {
+			if (i < n)
+				beam[i] = children[i];
+			else
+				state_free(children[i].state);
+		}
+		nodes += m;
+	}
+
+	double s = (clock_ns() - start) / 1e9;
+	printf("beam search: %ld nodes in %.2f s, %.0f nodes/s, %.1f dirty pages/node, best %d\n",
+		nodes, s, nodes / s, (double)pages / nodes, beam[0].score);
+
+	for (int i = 0; i < n; i++)
+		state_free(beam[i].state);
+}
+
+/*
+ * the same search, same tie breaks included, keeping a full snapshot per
+ * node instead of shared pages. snapshots of dropped nodes are reused.
+ */
+static void
+beam_copy(struct Machine *machine, struct Snapshot *root) {
+	struct CopyNode beam[WIDTH];
+	struct CopyNode children[WIDTH * ACTIONS];
+	int n = 1;
+	long nodes = 0;
+
+	for (int i = 0; i < WIDTH; i++)
+		beam[i].snap = malloc(sizeof(struct Snapshot));
+	for (int i = 0; i < WIDTH * ACTIONS; i++)
+		children[i].snap = malloc(sizeof(struct Snapshot));
+
+	machine->emulate = emulate; // nothing to mark dirty
+	seed = 1;
+	*beam[0].snap = *root;
+	beam[0].score = 0;
+	uint64_t start = clock_ns();
+
+	for (int depth = 0; depth < DEPTH; depth++) {
+		int m = 0;
+		for (int i = 0; i < n; i++) {
+			for (int a = 0; a < ACTIONS; a++) {
+				snapshot_restore(beam[i].snap, machine);
+				machine->iports[1] = invaders_buttons[a];
+				machine_frame(machine);
+
+				snapshot_take(children[m].snap, machine);
+				children[m].score = score(machine);
+				children[m].key = rnd();
+				m++;
+			}
+		}
+
+		qsort(children, m, sizeof(children[0]), by_copy_score);
+		n = m < WIDTH ? m : WIDTH;
+		for (int i = 0; i < n; i++) {
+			struct Snapshot *old = beam[i].snap;
+			beam[i] = children[i];
+			children[i].snap = old;
+		}
+		nodes += m;
+	}
+
+	double s = (clock_ns() - start) / 1e9;
+	printf("full copies: %ld nodes in %.2f s, %.0f nodes/s, best %d\n", nodes, s, nodes / s, beam[0].score);
+
+	for (int i = 0; i < WIDTH; i++)
+		free(beam[i].snap);
+	for (int i = 0; i < WIDTH * ACTIONS; i++)
+		free(children[i].snap);
+}
+
+int
+main(int argc, char **argv) {
+	struct Invaders env;
+	struct Workspace ws;
+
+	if (invaders_init(&env, argc > 1 ? argv[1] : "space-invaders.rom", OBS_NONE))
+		return 1;
+	if (invaders_reset(&env, NULL))
+		return 1;
+
+	workspace_init(&ws, &env.machine);
+	struct State *root = state_capture(&ws);
+
+	uint64_t start = clock_ns();
+	for (int i = 0; i < CLONES; i++)
+		state_free(state_clone(root));
+	double s = (clock_ns() - start) / 1e9;
+	printf("state_clone: %.0f clones/s\n", CLONES / s);
+
+	struct Snapshot *snap = malloc(sizeof(*snap));
+	start = clock_ns();
+	for (int i = 0; i < CLONES; i++)
+		snapshot_take(snap, &env.machine);
+	s = (clock_ns() - start) / 1e9;
+	printf("snapshot_take: %.0f copies/s\n", CLONES / s);
+
+	beam(&ws, root);
+	beam_copy(&env.machine, snap);
+
+	state_free(root);
+	workspace_free(&ws);
+	free(snap);
+	invaders_free(&env);
+	return 0;
+}
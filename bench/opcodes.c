@@ -0,0 +1,275 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/cpu.h"
+#include "../src/clock.h"
+
+#define BODY 64 // copies of the instruction per loop iteration
+#define RUNS 3 // best of
+#define CASES 256
+
+static const char *regs[] = { "B", "C", "D", "E", "H", "L", "M", "A" };
+static const char *pairs[] = { "B", "D", "H", "SP" };
+static const char *stack[] = { "B", "D", "H", "PSW" };
+static const char *conds[] = { "NZ", "Z", "NC", "C", "PO", "PE", "P", "M" };
+static const char *alu[] = { "ADD", "ADC", "SUB", "SBB", "ANA", "XRA", "ORA", "CMP" };
+static const char *imm[] = { "ADI", "ACI", "SUI", "SBI", "ANI", "XRI", "ORI", "CPI" };
+
+// flag setups that make each condition true, see conds
+static const uint8_t nz[] = { 0x3e, 0x01, 0xb7 }; // MVI A,1; ORA A
+static const uint8_t z[] = { 0xaf }; // XRA A
+static const uint8_t c[] = { 0x3e, 0x01, 0xb7, 0x37 }; // ... STC
+static const uint8_t m[] = { 0x3e, 0x80, 0xb7 }; // MVI A,$80; ORA A
+
+static const struct {
+	const uint8_t *code;
+	int len;
+} setup[] = {
+	{ nz, sizeof(nz) }, { z, sizeof(z) }, { nz, sizeof(nz) }, { c, sizeof(c) },
+	{ nz, sizeof(nz) }, { z, sizeof(z) }, { nz, sizeof(nz) }, { m, sizeof(m) },
+};
+
+/*
+ * one generated program: the prologue, then a loop of BODY copies of code
+ * closed by a JMP. with ret set, code calls a subroutine that is nothing
+ * but that return.
+ */
+struct Case {
+	const char *class;
+	char name[24];
+	uint8_t code[3];
+	int len;
+	int instructions; // executed per copy of code
+	uint8_t ret;
+	int cond; // setup index, -1 for none
+	double ns;
+};
+
+static struct Case cases[CASES];
+static int ncases;
+static uint8_t iports[4];
+static uint8_t oports[7];
+
+static struct Case *
+add(const char *class, const char *name, int len, uint8_t b0, uint8_t b1, uint8_t b2) {
+	struct Case *t = &cases[ncases++];
+	t->class = class;
+	snprintf(t->name, sizeof(t->name), "%s", name);
+	t->code[0] = b0;
+	t->code[1] = b1;
+	t->code[2] = b2;
+	t->len = len;
+	t->instructions = 1;
+	t->cond = -1;
+	return t;
+}
+
+static void
+generate(void) {
+	char name[24];
+
+	for (int d = 0; d < 8; d++) {
+		for (int s = 0; s < 8; s++) {
+			uint8_t op = 0x40 | d << 3 | s;
+			if (op == 0x76 || op == 0x7f) // HLT, and MOV A,A is unimplemented
+				continue;
+			snprintf(name, sizeof(name), "MOV %s,%s", regs[d], regs[s]);
+			add(d == 6 || s == 6 ? "MOV r,M" : "MOV r,r", name, 1, op, 0, 0);
+		}
+	}
+
+	for (int i = 0; i < 8; i++) {
+		for (int s = 0; s < 8; s++) {
+			snprintf(name, sizeof(name), "%s %s", alu[i], regs[s]);
+			add("ALU r", name, 1, 0x80 | i << 3 | s, 0, 0);
+		}
+	}
+
+	for (int i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "%s $5a", imm[i]);
+		add("ALU imm", name, 2, 0xc6 | i << 3, 0x5a, 0);
+	}
+
+	for (int i = 0; i < 4; i++) {
+		snprintf(name, sizeof(name), "DAD %s", pairs[i]);
+		add("DAD", name, 1, 0x09 | i << 4, 0, 0);
+	}
+
+	for (int i = 0; i < 4; i++) {
+		snprintf(name, sizeof(name), "PUSH/POP %s", stack[i]);
+		add("PUSH/POP", name, 2, 0xc5 | i << 4, 0xc1 | i << 4, 0)->instructions = 2;
+	}
+
+	for (int i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "C%s/R%s", conds[i], conds[i]);
+		struct Case *t = add("CALL/RET", name, 3, 0xc4 | i << 3, 0, 0);
+		t->instructions = 2;
+		t->ret = 0xc0 | i << 3;
+		t->cond = i;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		snprintf(name, sizeof(name), "IN $%02x", i);
+		add("IN/OUT", name, 2, 0xdb, i, 0);
+	}
+	for (int i = 2; i < 7; i++) {
+		snprintf(name, sizeof(name), "OUT $%02x", i);
+		add("IN/OUT", name, 2, 0xd3, i, 0);
+	}
+}
+
+/*
+ * lays the program out in memory. HL points at a page filled with $80 so
+ * MOV H,M and MOV L,M keep it there, and the stack sits well above.
+ */
+static int
+assemble(const struct Case *t, uint8_t *ram) {
+	static const uint8_t init[] = {
+		0x31, 0x00, 0xf0, // LXI SP,$f000
+		0x21, 0x00, 0x80, // LXI H,$8000
+		0x01, 0x02, 0x01, // LXI B,$0102
+		0x11, 0x04, 0x03, // LXI D,$0304
+	};
+	int pc = 0;
+
+	memset(ram, 0, 0x10000);
+	memset(&ram[0x8000], 0x80, 0x100);
+	memcpy(ram, init, sizeof(init));
+	pc += sizeof(init);
+
+	if (t->cond >= 0) {
+		memcpy(&ram[pc], setup[t->cond].code, setup[t->cond].len);
+		pc += setup[t->cond].len;
+	}
+
+	uint16_t loop = pc;
+	uint16_t sub = loop + BODY * t->len + 3;
+	for (int i = 0; i < BODY; i++) {
+		memcpy(&ram[pc], t->code, t->len);
+		if (t->ret) {
+			ram[pc + 1] = sub & 0xff;
+			ram[pc + 2] = sub >> 8;
+		}
+		pc += t->len;
+	}
+
+	ram[pc++] = 0xc3; // JMP loop
+	ram[pc++] = loop & 0xff;
+	ram[pc++] = loop >> 8;
+	ram[pc++] = t->ret;
+
+	return loop;
+}
+
+// best ns per emulate() call over RUNS runs of n instructions
+static double
+run(const struct Case *t, uint8_t *ram, long n) {
+	double best = 0;
+
+	for (int r = 0; r < RUNS; r++) {
+		struct CPU cpu = {0};
+		cpu.ram = ram;
+		for (int i = 0; i < 4; i++)
+			cpu.iports[i] = &iports[i];
+		for (int i = 0; i < 7; i++)
+			cpu.oports[i] = &oports[i];
+
+		uint16_t loop = assemble(t, ram);
+		while (cpu.pc != loop) // the prologue
+			emulate(&cpu);
+
+		uint64_t start = clock_ns();
+		for (long i = 0; i < n; i++)
+			emulate(&cpu);
+		double ns = (double)(clock_ns() - start) / n;
+
+		if (r == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-n instructions] [-c class] [-b baseline] [-t percent]\n", name);
+	exit(1);
+}
+
+/*
+ * times emulate() on generated programs, one per opcode, and prints
+ * ns/instruction with the cost of the loop's JMP taken out. the output
+ * can be saved and passed back with -b to flag opcodes that got slower.
+ */
+int
+main(int argc, char **argv) {
+	long n = 1000000;
+	char *class = NULL;
+	char *baseline = NULL;
+	double threshold = 10;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:c:b:t:")) != -1) {
+		switch (opt) {
+			case 'n': n = atol(optarg); break;
+			case 'c': class = optarg; break;
+			case 'b': baseline = optarg; break;
+			case 't': threshold = atof(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	uint8_t *ram = malloc(0x10000);
+	generate();
+
+	struct Case jmp = { .class = "", .len = 0, .cond = -1 };
+	double loop = run(&jmp, ram, n);
+	printf("# emulate() ns/instruction, JMP overhead %.2f ns\n", loop);
+
+	for (int i = 0; i < ncases; i++) {
+		struct Case *t = &cases[i];
+		if (class && strcmp(class, t->class))
+			continue;
+
+		// per loop: BODY copies of the case's instructions and one JMP
+		double per_loop = run(t, ram, n) * (BODY * t->instructions + 1);
+		t->ns = (per_loop - loop) / (BODY * t->instructions);
+		printf("%02x%02x %8.2f  %-9s %s\n", t->code[0], t->code[1], t->ns, t->class, t->name);
+	}
+
+	if (baseline == NULL)
+		return 0;
+
+	FILE *f = fopen(baseline, "r");
+	if (f == NULL) {
+		perror(baseline);
+		return 1;
+	}
+
+	char line[128];
+	int bad = 0;
+	while (fgets(line, sizeof(line), f)) {
+		unsigned key;
+		double ns;
+		if (sscanf(line, "%x %lf", &key, &ns) != 2)
+			continue;
+
+		for (int i = 0; i < ncases; i++) {
+			struct Case *t = &cases[i];
+			if (t->ns == 0 || key != (unsigned)(t->code[0] << 8 | t->code[1]))
+				continue;
+			if (t->ns > ns * (1 + threshold / 100)) {
+				fprintf(stderr, "%-12s %.2f -> %.2f ns\n", t->name, ns, t->ns);
+				bad++;
+			}
+		}
+	}
+	fclose(f);
+
+	if (bad)
+		fprintf(stderr, "%d opcodes slower than %s\n", bad, baseline);
+	return bad != 0;
+}
@@ -0,0 +1,316 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "machine.h"
+#include "snapshot.h"
+#include "dissasemble.h"
+#include "analyse.h"
+
+static const char MAGIC[8] = "SIVCFG01";
+static const uint16_t entries[] = { 0x0000, 0x0008, 0x0010 }; // reset, RST 1, RST 2
+
+// the opcodes emulate() stops on
+static int
+illegal(uint8_t op) {
+	return ((op & 0xc7) == 0 && op != 0) ||
+		op == 0xcb || op == 0xd9 || op == 0xdd || op == 0xed || op == 0xfd;
+}
+
+static int
+jump(uint8_t op) {
+	return op == 0xc3;
+}
+
+static int
+branch(uint8_t op) {
+	return (op & 0xc7) == 0xc2;
+}
+
+static int
+call(uint8_t op) {
+	return op == 0xcd || (op & 0xc7) == 0xc4 || (op & 0xc7) == 0xc7;
+}
+
+// control does not reach the next instruction
+static int
+ends(uint8_t op) {
+	return op == 0xc3 || op == 0xc9 || op == 0xe9 || op == 0x76;
+}
+
+// the target of a jump or call at pc
+static uint16_t
+target(const uint8_t *rom, uint16_t pc) {
+	uint8_t op = rom[pc];
+	if ((op & 0xc7) == 0xc7)
+		return op & 0x38;
+	return rom[pc + 2] << 8 | rom[pc + 1];
+}
+
+static int
+transfer(uint8_t op) {
+	return jump(op) || branch(op) || call(op) || ends(op) || (op & 0xc7) == 0xc0;
+}
+
+static int
+by_address(const void *x, const void *y) {
+	return *(const uint16_t *)x - *(const uint16_t *)y;
+}
+
+/*
+ * marks every instruction reachable from the vectors, then cuts them
+ * into blocks at each transfer of control and each target of one.
+ */
+void
+analyse(struct Analysis *an, const uint8_t *rom) {
+	static uint8_t leader[ROM_SIZE];
+	uint16_t work[ROM_SIZE];
+	int top = 0;
+
+	memset(an, 0, sizeof(*an));
+	memset(leader, 0, sizeof(leader));
+	an->rom = rom_hash(rom, ROM_SIZE);
+
+	for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+		work[top++] = entries[i];
+		leader[entries[i]] = 1;
+	}
+
+	while (top > 0) {
+		uint16_t pc = work[--top];
+		while (pc < ROM_SIZE && an->kind[pc] == BYTE_DATA) {
+			uint8_t op = rom[pc];
+			int len = disassemble_length(op);
+			if (illegal(op) || pc + len > ROM_SIZE)
+				break;
+
+			an->kind[pc] = BYTE_CODE;
+			for (int i = 1; i < len; i++)
+				an->kind[pc + i] = BYTE_OPERAND;
+
+			if (jump(op) || branch(op) || call(op)) {
+				uint16_t to = target(rom, pc);
+				if (to < ROM_SIZE && !leader[to]) {
+					leader[to] = 1;
+					if (top < ROM_SIZE)
+						work[top++] = to;
+				}
+				if (call(op) && to < ROM_SIZE && leader[to] == 1) {
+					leader[to] = 2; // counted as a call target once
+					an->calls[an->ncalls++] = to;
+				}
+			}
+			if (ends(op))
+				break;
+			pc += len;
+			if (transfer(op) && pc < ROM_SIZE && !leader[pc])
+				leader[pc] = 1;
+		}
+	}
+
+	qsort(an->calls, an->ncalls, sizeof(an->calls[0]), by_address);
+
+	for (uint16_t pc = 0; pc < ROM_SIZE;) {
+		if (an->kind[pc] != BYTE_CODE) {
+			pc++;
+			continue;
+		}
+
+		struct Block *b = &an->blocks[an->nblocks++];
+		uint16_t last;
+		b->start = pc;
+		do {
+			last = pc;
+			pc += disassemble_length(rom[pc]);
+		} while (pc < ROM_SIZE && an->kind[pc] == BYTE_CODE && !leader[pc] && !transfer(rom[last]));
+		b->end = pc;
+
+		uint8_t op = rom[last];
+		if (jump(op) || branch(op) || call(op)) {
+			uint16_t to = target(rom, last);
+			if (to < ROM_SIZE && an->kind[to] == BYTE_CODE)
+				an->edges[an->nedges++] = (struct Edge){ b->start, to,
+					jump(op) ? EDGE_JUMP : branch(op) ? EDGE_BRANCH : EDGE_CALL };
+		}
+		if (!ends(op) && pc < ROM_SIZE && an->kind[pc] == BYTE_CODE)
+			an->edges[an->nedges++] = (struct Edge){ b->start, pc, EDGE_FALL };
+	}
+
+	for (uint16_t pc = 0; pc < ROM_SIZE;) {
+		if (an->kind[pc] != BYTE_DATA) {
+			pc++;
+			continue;
+		}
+		struct Region *r = &an->data[an->ndata++];
+		r->start = pc;
+		while (pc < ROM_SIZE && an->kind[pc] == BYTE_DATA)
+			pc++;
+		r->end = pc;
+	}
+}
+
+// index of the block holding adr, -1 if it is not code
+int
+analysis_block(const struct Analysis *an, uint16_t adr) {
+	int lo = 0;
+	int hi = an->nblocks - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (adr < an->blocks[mid].start)
+			hi = mid - 1;
+		else if (adr >= an->blocks[mid].end)
+			lo = mid + 1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+// host byte order like snapshots, only counts and the used entries are written
+int
+analysis_save(const struct Analysis *an, const char *path) {
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+	FILE *f = fopen(tmp, "wb");
+	if (f == NULL) {
+		perror(tmp);
+		return 1;
+	}
+
+	int32_t counts[] = { an->nblocks, an->nedges, an->ncalls, an->ndata };
+	fwrite(MAGIC, 1, sizeof(MAGIC), f);
+	fwrite(&an->rom, sizeof(an->rom), 1, f);
+	fwrite(counts, sizeof(counts), 1, f);
+	fwrite(an->kind, 1, sizeof(an->kind), f);
+	fwrite(an->blocks, sizeof(an->blocks[0]), an->nblocks, f);
+	fwrite(an->edges, sizeof(an->edges[0]), an->nedges, f);
+	fwrite(an->calls, sizeof(an->calls[0]), an->ncalls, f);
+	fwrite(an->data, sizeof(an->data[0]), an->ndata, f);
+
+	if (fclose(f) || rename(tmp, path)) {
+		perror(path);
+		remove(tmp);
+		return 1;
+	}
+	return 0;
+}
+
+int
+analysis_load(struct Analysis *an, const char *path) {
+	char magic[sizeof(MAGIC)];
+	int32_t counts[4];
+	size_t ok = 0;
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return 1;
+
+	memset(an, 0, sizeof(*an));
+	ok += fread(magic, sizeof(magic), 1, f);
+	ok += fread(&an->rom, sizeof(an->rom), 1, f);
+	ok += fread(counts, sizeof(counts), 1, f);
+	if (ok != 3 || memcmp(magic, MAGIC, sizeof(MAGIC)) ||
+			counts[0] < 0 || counts[0] > ROM_SIZE || counts[1] < 0 || counts[1] > 2 * ROM_SIZE ||
+			counts[2] < 0 || counts[2] > ROM_SIZE || counts[3] < 0 || counts[3] > ROM_SIZE) {
+		fclose(f);
+		fprintf(stderr, "%s: not an analysis\n", path);
+		return 1;
+	}
+
+	an->nblocks = counts[0];
+	an->nedges = counts[1];
+	an->ncalls = counts[2];
+	an->ndata = counts[3];
+	ok = fread(an->kind, sizeof(an->kind), 1, f);
+	ok += fread(an->blocks, sizeof(an->blocks[0]), an->nblocks, f) == (size_t)an->nblocks;
+	ok += fread(an->edges, sizeof(an->edges[0]), an->nedges, f) == (size_t)an->nedges;
+	ok += fread(an->calls, sizeof(an->calls[0]), an->ncalls, f) == (size_t)an->ncalls;
+	ok += fread(an->data, sizeof(an->data[0]), an->ndata, f) == (size_t)an->ndata;
+	fclose(f);
+
+	if (ok != 5) {
+		fprintf(stderr, "%s: truncated analysis\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+// analyse() through the per rom cache, returns 1 if it had to analyse
+int
+analyse_cached(struct Analysis *an, const uint8_t *rom) {
+	char path[1024];
+	uint64_t hash = rom_hash(rom, ROM_SIZE);
+	int cached = cache_path(path, sizeof(path), hash, "analysis.bin") == 0;
+
+	if (cached && analysis_load(an, path) == 0 && an->rom == hash)
+		return 0;
+
+	analyse(an, rom);
+	if (cached)
+		analysis_save(an, path);
+	return 1;
+}
+
+static const char *edge_names[] = {
+	[EDGE_JUMP] = "jump",
+	[EDGE_BRANCH] = "branch",
+	[EDGE_CALL] = "call",
+	[EDGE_FALL] = "fall",
+};
+
+// a disassembled listing, one block at a time with its edges out
+void
+analysis_text(const struct Analysis *an, const uint8_t *rom, FILE *f) {
+	char line[DISASM_MAX];
+	int code = 0;
+	int e = 0;
+
+	for (int i = 0; i < an->nblocks; i++)
+		code += an->blocks[i].end - an->blocks[i].start;
+	fprintf(f, "; rom %016llx: %d blocks, %d edges, %d call targets, %d code bytes, %d data regions\n",
+		(unsigned long long)an->rom, an->nblocks, an->nedges, an->ncalls, code, an->ndata);
+
+	for (int i = 0; i < an->nblocks; i++) {
+		const struct Block *b = &an->blocks[i];
+		fprintf(f, "\nblock %04x-%04x\n", b->start, b->end - 1);
+		for (uint16_t pc = b->start; pc < b->end;) {
+			pc += disassemble_line(&rom[pc], pc, line);
+			fprintf(f, "\t%s\n", line);
+		}
+		for (; e < an->nedges && an->edges[e].from == b->start; e++)
+			fprintf(f, "\t-> %04x %s\n", an->edges[e].to, edge_names[an->edges[e].type]);
+	}
+
+	fprintf(f, "\ncalls");
+	for (int i = 0; i < an->ncalls; i++)
+		fprintf(f, " %04x", an->calls[i]);
+	fprintf(f, "\n\ndata\n");
+	for (int i = 0; i < an->ndata; i++)
+		fprintf(f, "\t%04x-%04x %d bytes\n", an->data[i].start, an->data[i].end - 1,
+			an->data[i].end - an->data[i].start);
+}
+
+// the block graph for graphviz, calls dashed and fall-through dotted
+void
+analysis_dot(const struct Analysis *an, FILE *f) {
+	static const char *styles[] = {
+		[EDGE_JUMP] = "solid",
+		[EDGE_BRANCH] = "bold",
+		[EDGE_CALL] = "dashed",
+		[EDGE_FALL] = "dotted",
+	};
+
+	fprintf(f, "digraph rom {\n\tnode [shape=box fontname=monospace];\n");
+	for (int i = 0; i < an->nblocks; i++)
+		fprintf(f, "\tb%04x [label=\"%04x-%04x\"];\n", an->blocks[i].start,
+			an->blocks[i].start, an->blocks[i].end - 1);
+	for (int i = 0; i < an->nedges; i++)
+		fprintf(f, "\tb%04x -> b%04x [style=%s];\n", an->edges[i].from,
+			an->edges[i].to, styles[an->edges[i].type]);
+	fprintf(f, "}\n");
+}
@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#define ROM_SIZE 0x2000
+
+// what each rom byte was found to be
+enum BYTE_KIND {
+	BYTE_DATA, // never reached from an entry point
+	BYTE_CODE, // first byte of an instruction
+	BYTE_OPERAND,
+};
+
+enum EDGE_TYPE {
+	EDGE_JUMP, // JMP
+	EDGE_BRANCH, // Jcc taken
+	EDGE_CALL, // CALL, Ccc, RST
+	EDGE_FALL, // on to the next block
+};
+
+struct Block {
+	uint16_t start;
+	uint16_t end; // one past the last instruction byte
+};
+
+struct Edge {
+	uint16_t from; // block starts
+	uint16_t to;
+	uint8_t type;
+};
+
+struct Region {
+	uint16_t start;
+	uint16_t end;
+};
+
+/*
+ * the code of a rom as found by following control flow from the reset
+ * and interrupt vectors. jumps through PCHL and code only reached that
+ * way are not followed, so what is left as data may still hold some.
+ */
+struct Analysis {
+	uint64_t rom; // rom_hash()
+	uint8_t kind[ROM_SIZE];
+	int nblocks;
+	int nedges;
+	int ncalls;
+	int ndata;
+	struct Block blocks[ROM_SIZE];
+	struct Edge edges[2 * ROM_SIZE];
+	uint16_t calls[ROM_SIZE]; // distinct call targets
+	struct Region data[ROM_SIZE];
+};
+
+void analyse(struct Analysis *an, const uint8_t *rom);
+int analyse_cached(struct Analysis *an, const uint8_t *rom);
+int analysis_save(const struct Analysis *an, const char *path);
+int analysis_load(struct Analysis *an, const char *path);
+int analysis_block(const struct Analysis *an, uint16_t adr);
+void analysis_text(const struct Analysis *an, const uint8_t *rom, FILE *f);
+void analysis_dot(const struct Analysis *an, FILE *f);
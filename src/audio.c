@@ -0,0 +1,402 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef HEADLESS
+#include <SDL2/SDL.h>
+#endif
+
+#include "audio.h"
+
+static const int16_t VOLUME = 8000; // per sound, so a few at once do not clip
+
+static uint32_t
+le32(const uint8_t *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t
+le16(const uint8_t *p) {
+	return p[0] | p[1] << 8;
+}
+
+// 8 or 16 bit pcm, mono or stereo at any rate, to mono at AUDIO_EMU_RATE
+static int
+load_wav(struct Sample *s, const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return 1;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *buf = malloc(size > 0 ? size : 1);
+	size_t got = fread(buf, 1, size > 0 ? size : 0, f);
+	fclose(f);
+
+	const uint8_t *data = NULL;
+	uint32_t bytes = 0;
+	int channels = 0, rate = 0, bits = 0;
+	if (got >= 12 && memcmp(buf, "RIFF", 4) == 0 && memcmp(&buf[8], "WAVE", 4) == 0) {
+		for (size_t at = 12; at + 8 <= got;) {
+			uint32_t len = le32(&buf[at + 4]);
+			const uint8_t *chunk = &buf[at + 8];
+			if (len > got - at - 8)
+				len = got - at - 8;
+			if (memcmp(&buf[at], "fmt ", 4) == 0 && len >= 16 && le16(chunk) == 1) {
+				channels = le16(&chunk[2]);
+				rate = le32(&chunk[4]);
+				bits = le16(&chunk[14]);
+			} else if (memcmp(&buf[at], "data", 4) == 0) {
+				data = chunk;
+				bytes = len;
+			}
+			at += 8 + len + (len & 1);
+		}
+	}
+	if (data == NULL || channels < 1 || channels > 2 || rate <= 0 || (bits != 8 && bits != 16)) {
+		fprintf(stderr, "%s: not an 8 or 16 bit pcm wav\n", path);
+		free(buf);
+		return 1;
+	}
+
+	int frame = channels * bits / 8;
+	uint32_t frames = bytes / frame;
+	s->len = (uint64_t)frames * AUDIO_EMU_RATE / rate;
+	if (s->len == 0) {
+		free(buf);
+		return 1;
+	}
+	s->pcm = malloc(s->len * sizeof(s->pcm[0]));
+	for (uint32_t i = 0; i < s->len; i++) {
+		const uint8_t *p = &data[(uint64_t)i * rate / AUDIO_EMU_RATE * frame];
+		int32_t v = 0;
+		for (int c = 0; c < channels; c++)
+			v += bits == 16 ? (int16_t)le16(&p[c * 2]) : (p[c] - 128) * 256;
+		s->pcm[i] = v / channels;
+	}
+	free(buf);
+	return 0;
+}
+
+// 0 to 1 and back, hz times a second
+static double
+triangle(double t, double hz) {
+	double x = t * hz - (int)(t * hz);
+	return x < 0.5 ? x * 2 : 2 - x * 2;
+}
+
+// rough stand-ins for the cabinet's analog circuits
+static void
+synth(struct Sample *s, enum SOUND sound) {
+	static const double seconds[AUDIO_SOUNDS] = { 0.1, 0.4, 1.0, 0.3, 0.1, 0.1, 0.1, 0.1, 0.8 };
+	static const double fleet[] = { 110, 98, 87, 82 };
+	uint32_t noise = 0x2545f491;
+	double phase = 0;
+	double lp = 0;
+
+	s->len = seconds[sound] * AUDIO_EMU_RATE;
+	s->pcm = malloc(s->len * sizeof(s->pcm[0]));
+	for (uint32_t i = 0; i < s->len; i++) {
+		double t = (double)i / AUDIO_EMU_RATE;
+		double left = 1.0 - (double)i / s->len;
+		noise ^= noise << 13;
+		noise ^= noise >> 17;
+		noise ^= noise << 5;
+		double n = (int32_t)noise / 2147483648.0;
+
+		double hz = 0;
+		switch (sound) {
+			case SOUND_UFO: hz = 500 + 300 * triangle(t, 10); break; // one period, so it loops
+			case SOUND_SHOT: hz = 300 + 1300 * left; break;
+			case SOUND_UFO_HIT: hz = 900 + 300 * triangle(t, 16); break;
+			case SOUND_FLEET1: case SOUND_FLEET2: case SOUND_FLEET3: case SOUND_FLEET4:
+				hz = fleet[sound - SOUND_FLEET1];
+				break;
+			default: break;
+		}
+		phase += hz / AUDIO_EMU_RATE;
+		phase -= (int)phase;
+		double square = phase < 0.5 ? 1 : -1;
+
+		double v;
+		switch (sound) {
+			case SOUND_UFO: v = square; break;
+			case SOUND_SHOT: v = (0.6 * square + 0.4 * n) * left; break;
+			case SOUND_DIE: lp += (n - lp) * 0.15; v = 2 * lp * left; break;
+			case SOUND_KILL: lp += (n - lp) * 0.5; v = lp * left * left; break;
+			case SOUND_UFO_HIT: v = square * left; break;
+			default: v = square * (left > 0.2 ? 1 : left * 5); break;
+		}
+		if (v > 1)
+			v = 1;
+		if (v < -1)
+			v = -1;
+		s->pcm[i] = v * VOLUME;
+	}
+}
+
+/*
+ * loads dir/0.wav ... dir/8.wav where they exist and synthesises the
+ * rest. everything is allocated here, nothing after.
+ */
+int
+audio_init(struct Audio *audio, const char *dir) {
+	char path[1024];
+
+	memset(audio, 0, sizeof(*audio));
+	audio->rate = AUDIO_RATE;
+	audio->speed = 1;
+	for (int i = 0; i < AUDIO_SOUNDS; i++) {
+		snprintf(path, sizeof(path), "%s/%d.wav", dir ? dir : ".", i);
+		if (dir == NULL || load_wav(&audio->samples[i], path))
+			synth(&audio->samples[i], i);
+		if (audio->samples[i].pcm == NULL)
+			return 1;
+	}
+	return 0;
+}
+
+void
+audio_free(struct Audio *audio) {
+	for (int i = 0; i < AUDIO_SOUNDS; i++) {
+		free(audio->samples[i].pcm);
+		audio->samples[i].pcm = NULL;
+	}
+}
+
+// starts a sound on each rising trigger bit, the ufo stops when its bit drops
+static void
+trigger(struct Audio *audio, uint8_t port3, uint8_t port5) {
+	uint16_t now = (port3 & 0x0f) | (port5 & 0x1f) << 4;
+	uint16_t before = (audio->port3 & 0x0f) | (audio->port5 & 0x1f) << 4;
+	uint16_t rising = now & ~before;
+
+	for (int i = 0; i < AUDIO_SOUNDS; i++) {
+		if (rising >> i & 1)
+			audio->pos[i] = 0;
+	}
+	audio->playing |= rising;
+	if (!(now & 1 << SOUND_UFO))
+		audio->playing &= ~(1 << SOUND_UFO);
+
+	audio->port3 = port3;
+	audio->port5 = port5;
+}
+
+/*
+ * queues the ports as written at cycles into the period the next
+ * audio_mix() covers. a full queue keeps the latest ports in its last
+ * entry, edges in between are lost.
+ */
+void
+audio_write(struct Audio *audio, uint32_t at, uint8_t port3, uint8_t port5) {
+	if (audio->nevents == AUDIO_EVENTS)
+		audio->nevents--;
+	audio->events[audio->nevents++] = (struct AudioEvent){ at, port3, port5 };
+}
+
+// n emulated samples of the playing sounds
+static void
+render(struct Audio *audio, float *out, uint32_t n) {
+	int amp = audio->port3 & 0x20; // the rom turns the amplifier off outside games
+
+	for (uint32_t i = 0; i < n; i++) {
+		int32_t v = 0;
+		for (int s = 0; audio->playing >> s; s++) {
+			if (!(audio->playing >> s & 1))
+				continue;
+			v += audio->samples[s].pcm[audio->pos[s]];
+			if (++audio->pos[s] < audio->samples[s].len)
+				continue;
+			audio->pos[s] = 0;
+			if (s != SOUND_UFO)
+				audio->playing &= ~(1 << s);
+		}
+		out[i] = amp ? v : 0;
+	}
+}
+
+/*
+ * linear interpolation at at, at + step, ... no branches or carried
+ * state. audio.o is built at -O3 for gcc to vectorise it, the loads
+ * becoming gathers on a -march with AVX2.
+ */
+static void
+resample(float *restrict out, const float *restrict in, float at, float step, uint32_t n) {
+	for (uint32_t i = 0; i < n; i++) {
+		float p = at + i * step;
+		int k = p;
+		float t = p - k;
+		out[i] = in[k] + (in[k + 1] - in[k]) * t;
+	}
+}
+
+// into the ring, clamped, dropping what does not fit
+static void
+push(struct Audio *audio, const float *in, uint32_t n) {
+	uint32_t head = audio->head;
+	uint32_t room = AUDIO_RING - (head - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE));
+
+	if (n > room) {
+		audio->dropped += n - room;
+		n = room;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		float v = in ? in[i] : 0;
+		if (v > INT16_MAX)
+			v = INT16_MAX;
+		if (v < INT16_MIN)
+			v = INT16_MIN;
+		audio->ring[head++ & (AUDIO_RING - 1)] = v;
+	}
+	__atomic_store_n(&audio->head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * the m emulated samples in emu[1..m] to the host rate. at speed above
+ * one only 1/speed of the host samples the block would make are played,
+ * either the start of it at the normal pitch or silence. pitched slices
+ * are crossfaded: the next one fades in over how the last one went on.
+ */
+static void
+output(struct Audio *audio, uint32_t m) {
+	float out[AUDIO_BLOCK * 8];
+	double step = (double)AUDIO_EMU_RATE / audio->rate;
+	uint32_t n = 0;
+
+	if (audio->at < m)
+		n = (m - audio->at) / step + 1;
+	if (n > 0 && audio->at + (n - 1) * step >= m)
+		n--;
+	if (n > sizeof(out) / sizeof(out[0]))
+		n = sizeof(out) / sizeof(out[0]);
+
+	if (audio->speed <= 1) {
+		resample(out, audio->emu, audio->at, step, n);
+		push(audio, out, n);
+		audio->at += n * step - m;
+		audio->nfade = 0;
+	} else if (audio->fast == FAST_MUTE) {
+		push(audio, NULL, n / audio->speed);
+		audio->at += n * step - m;
+		audio->nfade = 0;
+	} else {
+		uint32_t len = n / audio->speed;
+		uint32_t tail = n - len < AUDIO_FADE ? n - len : AUDIO_FADE;
+		uint32_t fade = audio->nfade < len ? audio->nfade : len;
+
+		resample(out, audio->emu, audio->at, step, len + tail);
+		for (uint32_t i = 0; i < fade; i++) {
+			float w = (i + 1.0f) / (fade + 1);
+			out[i] = audio->fade[i] * (1 - w) + out[i] * w;
+		}
+		memcpy(audio->fade, &out[len], tail * sizeof(float));
+		audio->nfade = tail;
+		push(audio, out, len);
+		audio->at = 0;
+	}
+	audio->emu[0] = audio->emu[m];
+}
+
+/*
+ * renders the cycles since the last call on the emulated timeline,
+ * applying each queued port write at the sample it fell in, then
+ * resamples them into the ring. when the ring is full the samples are
+ * dropped, the emulation thread never waits on the callback.
+ */
+void
+audio_mix(struct Audio *audio, int cycles) {
+	uint32_t total = (audio->frac + cycles) / AUDIO_CYCLES;
+	uint32_t done = 0;
+	uint32_t e = 0;
+
+	while (done < total) {
+		uint32_t m = total - done < AUDIO_BLOCK ? total - done : AUDIO_BLOCK;
+		for (uint32_t k = 0; k < m;) {
+			uint32_t until = m;
+			for (; e < audio->nevents; e++) {
+				uint32_t sample = (audio->frac + audio->events[e].at) / AUDIO_CYCLES - done;
+				if (sample > k) {
+					until = sample < m ? sample : m;
+					break;
+				}
+				trigger(audio, audio->events[e].port3, audio->events[e].port5);
+			}
+			render(audio, &audio->emu[1 + k], until - k);
+			k = until;
+		}
+		output(audio, m);
+		done += m;
+	}
+
+	for (; e < audio->nevents; e++)
+		trigger(audio, audio->events[e].port3, audio->events[e].port5);
+	audio->nevents = 0;
+	audio->frac = (audio->frac + cycles) % AUDIO_CYCLES;
+}
+
+// samples mixed and not yet drained
+uint32_t
+audio_fill(struct Audio *audio) {
+	return __atomic_load_n(&audio->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE);
+}
+
+// the consumer side, where the ring runs short the last sample fades out instead of clicking
+void
+audio_drain(struct Audio *audio, int16_t *out, uint32_t n) {
+	uint32_t tail = audio->tail;
+	uint32_t have = __atomic_load_n(&audio->head, __ATOMIC_ACQUIRE) - tail;
+	uint32_t i = 0;
+
+	for (; i < n && i < have; i++)
+		out[i] = audio->ring[tail++ & (AUDIO_RING - 1)];
+	if (i > 0)
+		audio->last = out[i - 1];
+	if (i < n)
+		__atomic_fetch_add(&audio->underruns, n - i, __ATOMIC_RELAXED); // read by main.c for telemetry
+	for (; i < n; i++) {
+		audio->last -= audio->last / 16;
+		out[i] = audio->last;
+	}
+	__atomic_store_n(&audio->tail, tail, __ATOMIC_RELEASE);
+}
+
+#ifndef HEADLESS
+static void
+callback(void *user, Uint8 *stream, int len) {
+	audio_drain(user, (int16_t *)stream, len / sizeof(int16_t));
+}
+
+int
+audio_open(struct Audio *audio) {
+	SDL_AudioSpec want = {
+		.freq = AUDIO_RATE,
+		.format = AUDIO_S16SYS,
+		.channels = 1,
+		.samples = 512,
+		.callback = callback,
+		.userdata = audio,
+	};
+
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+		fprintf(stderr, "unable to init SDL audio: %s\n", SDL_GetError());
+		return 1;
+	}
+	SDL_AudioSpec have;
+	audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+	if (audio->device == 0) {
+		fprintf(stderr, "unable to open audio device: %s\n", SDL_GetError());
+		return 1;
+	}
+	audio->rate = have.freq;
+	SDL_PauseAudioDevice(audio->device, 0);
+	return 0;
+}
+
+void
+audio_close(struct Audio *audio) {
+	if (audio->device)
+		SDL_CloseAudioDevice(audio->device);
+	audio->device = 0;
+}
+#endif
@@ -0,0 +1,87 @@
+#include <stdint.h>
+
+#define AUDIO_RATE 44100 // asked of the device, it may pick another
+#define AUDIO_CYCLES 64 // cpu cycles per sample of the emulated timeline
+#define AUDIO_EMU_RATE (2000000 / AUDIO_CYCLES)
+#define AUDIO_RING 8192 // samples, a power of two
+#define AUDIO_BLOCK 1024 // emulated samples resampled at once
+#define AUDIO_EVENTS 256 // port writes kept between audio_mix() calls
+#define AUDIO_LATENCY 50 // ms of host samples the pacing keeps buffered
+#define AUDIO_SOUNDS 9
+#define AUDIO_FADE 64 // host samples between fast forward slices are crossfaded over
+
+// the nine cabinet sounds, numbered like the usual sample sets (0.wav ... 8.wav)
+enum SOUND {
+	SOUND_UFO, // port 3 bit 0, repeats while held
+	SOUND_SHOT, // port 3 bit 1
+	SOUND_DIE, // port 3 bit 2
+	SOUND_KILL, // port 3 bit 3
+	SOUND_FLEET1, // port 5 bits 0-3
+	SOUND_FLEET2,
+	SOUND_FLEET3,
+	SOUND_FLEET4,
+	SOUND_UFO_HIT, // port 5 bit 4
+};
+
+// what fast forward does to the sound
+enum AUDIO_FAST {
+	FAST_PITCH, // plays a slice of each block at the normal pitch
+	FAST_MUTE,
+};
+
+// a write to port 3 or 5, at cycles into the current audio_mix() period
+struct AudioEvent {
+	uint32_t at;
+	uint8_t port3;
+	uint8_t port5;
+};
+
+struct Sample {
+	int16_t *pcm;
+	uint32_t len;
+};
+
+/*
+ * the emulation thread feeds port writes and cycles in, renders them on
+ * the emulated timeline at AUDIO_EMU_RATE and resamples into the ring,
+ * the audio callback drains it. head is only written by the former and
+ * tail by the latter, so neither needs a lock.
+ */
+struct Audio {
+	struct Sample samples[AUDIO_SOUNDS]; // at AUDIO_EMU_RATE
+	uint32_t pos[AUDIO_SOUNDS];
+	uint16_t playing; // a bit per sound
+	uint8_t port3;
+	uint8_t port5;
+
+	struct AudioEvent events[AUDIO_EVENTS];
+	uint32_t nevents;
+	uint32_t frac; // cycles short of a whole emulated sample
+
+	int rate; // of the host
+	int speed; // emulated seconds per host second
+	enum AUDIO_FAST fast;
+	float emu[AUDIO_BLOCK + 1]; // the last sample of the previous block, then this one
+	double at; // where the next host sample falls in emu[]
+	float fade[AUDIO_FADE]; // how the last fast forward slice went on, faded out under the next
+	uint32_t nfade;
+
+	int16_t ring[AUDIO_RING];
+	uint32_t head;
+	uint32_t tail;
+	uint32_t dropped; // samples the ring had no room for
+	uint32_t underruns; // samples the callback found missing
+	int16_t last; // the callback's, faded out on an underrun
+
+	uint32_t device;
+};
+
+int audio_init(struct Audio *audio, const char *dir);
+void audio_free(struct Audio *audio);
+void audio_write(struct Audio *audio, uint32_t at, uint8_t port3, uint8_t port5);
+void audio_mix(struct Audio *audio, int cycles);
+uint32_t audio_fill(struct Audio *audio);
+void audio_drain(struct Audio *audio, int16_t *out, uint32_t n);
+
+int audio_open(struct Audio *audio);
+void audio_close(struct Audio *audio);
@@ -0,0 +1,356 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "video.h"
+#include "capture.h"
+
+static const char MAGIC[8] = "SIVRAW01";
+static const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+#define ROW_BYTES (CAPTURE_WIDTH / 8)
+#define PNG_DATA ((ROW_BYTES + 1) * CAPTURE_HEIGHT) // a filter byte per row
+#define PNG_SIZE (8 + 25 + 12 + 2 + 5 + PNG_DATA + 4 + 12)
+#define Y4M_SIZE (6 + CAPTURE_WIDTH * CAPTURE_HEIGHT * 3 / 2)
+#define RAW_SIZE (12 + CAPTURE_VRAM)
+
+static uint32_t crc_table[256];
+
+static void
+crc_init(void) {
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++)
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t
+crc32(const uint8_t *p, size_t len) {
+	uint32_t c = 0xffffffff;
+	for (size_t i = 0; i < len; i++)
+		c = crc_table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+	return c ^ 0xffffffff;
+}
+
+static uint32_t
+adler32(const uint8_t *p, size_t len) {
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < len; i++) {
+		a = (a + p[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return b << 16 | a;
+}
+
+static uint8_t *
+be32(uint8_t *p, uint32_t x) {
+	p[0] = x >> 24;
+	p[1] = x >> 16;
+	p[2] = x >> 8;
+	p[3] = x;
+	return p + 4;
+}
+
+// a chunk of len bytes already at p + 8, filling in its length, type and crc
+static uint8_t *
+chunk(uint8_t *p, const char *type, uint32_t len) {
+	be32(p, len);
+	memcpy(&p[4], type, 4);
+	return be32(&p[8 + len], crc32(&p[4], 4 + len));
+}
+
+// the upright screen, rows of 1bpp msb first. the cabinet's monitor is turned 90 degrees
+static void
+upright(const uint8_t *vram, uint8_t rows[CAPTURE_HEIGHT][ROW_BYTES]) {
+	memset(rows, 0, CAPTURE_HEIGHT * ROW_BYTES);
+	for (int x = 0; x < CAPTURE_WIDTH; x++) {
+		const uint8_t *column = &vram[x * (CAPTURE_HEIGHT / 8)];
+		uint8_t bit = 0x80 >> (x & 7);
+		for (int i = 0; i < CAPTURE_HEIGHT / 8; i++) {
+			uint8_t byte = column[i];
+			for (int p = 0; byte; p++, byte >>= 1) {
+				if (byte & 1)
+					rows[CAPTURE_HEIGHT - 1 - i * 8 - p][x / 8] |= bit;
+			}
+		}
+	}
+}
+
+// 1 bit greyscale, the zlib stream in one stored deflate block
+static size_t
+encode_png(const uint8_t *vram, uint8_t *out) {
+	uint8_t *p = out;
+	memcpy(p, PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+	p += sizeof(PNG_SIGNATURE);
+
+	uint8_t *ihdr = &p[8];
+	be32(&ihdr[0], CAPTURE_WIDTH);
+	be32(&ihdr[4], CAPTURE_HEIGHT);
+	ihdr[8] = 1; // bit depth
+	ihdr[9] = 0; // greyscale
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	p = chunk(p, "IHDR", 13);
+
+	uint8_t *z = &p[8];
+	z[0] = 0x78;
+	z[1] = 0x01;
+	z[2] = 1; // final block, stored
+	z[3] = PNG_DATA & 0xff;
+	z[4] = PNG_DATA >> 8;
+	z[5] = ~PNG_DATA & 0xff;
+	z[6] = ~PNG_DATA >> 8 & 0xff;
+	uint8_t *data = &z[7];
+	uint8_t rows[CAPTURE_HEIGHT][ROW_BYTES];
+	upright(vram, rows);
+	for (int y = 0; y < CAPTURE_HEIGHT; y++) {
+		data[y * (ROW_BYTES + 1)] = 0; // no filter
+		memcpy(&data[y * (ROW_BYTES + 1) + 1], rows[y], ROW_BYTES);
+	}
+	be32(&data[PNG_DATA], adler32(data, PNG_DATA));
+	p = chunk(p, "IDAT", 7 + PNG_DATA + 4);
+
+	p = chunk(p, "IEND", 0);
+	return p - out;
+}
+
+// 4:2:0 with the chroma planes grey
+static size_t
+encode_y4m(const uint8_t *vram, uint8_t *out) {
+	memcpy(out, "FRAME\n", 6);
+	uint8_t *luma = &out[6];
+	uint8_t rows[CAPTURE_HEIGHT][ROW_BYTES];
+	upright(vram, rows);
+	for (int y = 0; y < CAPTURE_HEIGHT; y++) {
+		for (int x = 0; x < CAPTURE_WIDTH; x++)
+			luma[y * CAPTURE_WIDTH + x] = rows[y][x / 8] & (0x80 >> (x & 7)) ? 235 : 16;
+	}
+	memset(&luma[CAPTURE_WIDTH * CAPTURE_HEIGHT], 128, CAPTURE_WIDTH * CAPTURE_HEIGHT / 2);
+	return Y4M_SIZE;
+}
+
+// host byte order like snapshots: the frame number, the length, the vram
+static size_t
+encode_raw(const struct CaptureBuffer *b, uint8_t *out) {
+	uint32_t len = CAPTURE_VRAM;
+	memcpy(out, &b->frame, sizeof(b->frame));
+	memcpy(&out[8], &len, sizeof(len));
+	memcpy(&out[12], b->vram, CAPTURE_VRAM);
+	return RAW_SIZE;
+}
+
+static int
+write_png(struct Capture *c, const struct CaptureBuffer *b) {
+	char path[1100];
+	snprintf(path, sizeof(path), "%s/%08llu.png", c->path, (unsigned long long)b->frame);
+
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	fwrite(b->out, 1, b->len, f);
+	if (fclose(f)) {
+		perror(path);
+		return 1;
+	}
+	return 0;
+}
+
+static void *
+work(void *arg) {
+	struct Capture *c = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&c->lock);
+		while (c->qlen == 0 && !c->stop)
+			pthread_cond_wait(&c->queued, &c->lock);
+		if (c->qlen == 0) {
+			pthread_mutex_unlock(&c->lock);
+			break;
+		}
+		int i = c->queue[c->qhead];
+		c->qhead = (c->qhead + 1) % c->nbuffers;
+		c->qlen--;
+		pthread_mutex_unlock(&c->lock);
+
+		struct CaptureBuffer *b = &c->buffers[i];
+		int failed = 0;
+		switch (c->format) {
+			case CAPTURE_PNG:
+				b->len = encode_png(b->vram, b->out);
+				failed = write_png(c, b);
+				break;
+			case CAPTURE_Y4M: b->len = encode_y4m(b->vram, b->out); break;
+			case CAPTURE_RAW: b->len = encode_raw(b, b->out); break;
+			case CAPTURE_VIDEO: break; // deltas need the frame before, coded in turn
+		}
+
+		pthread_mutex_lock(&c->lock);
+		if (c->format != CAPTURE_PNG) {
+			while (c->written != b->seq)
+				pthread_cond_wait(&c->turn, &c->lock);
+			// our turn, no other worker touches the stream until written moves
+			pthread_mutex_unlock(&c->lock);
+			if (c->video)
+				failed = video_frame(c->video, b->vram);
+			else
+				failed = fwrite(b->out, 1, b->len, c->f) != b->len;
+			pthread_mutex_lock(&c->lock);
+			c->written++;
+			pthread_cond_broadcast(&c->turn);
+		}
+		c->failed |= failed;
+		c->free[c->nfree++] = i;
+		pthread_cond_signal(&c->freed);
+		pthread_mutex_unlock(&c->lock);
+	}
+	return NULL;
+}
+
+// y4m and raw by extension, anything else is a directory of pngs
+enum CAPTURE_FORMAT
+capture_format(const char *path) {
+	const char *dot = strrchr(path, '.');
+	if (dot && strcmp(dot, ".y4m") == 0)
+		return CAPTURE_Y4M;
+	if (dot && strcmp(dot, ".raw") == 0)
+		return CAPTURE_RAW;
+	if (dot && strcmp(dot, ".siv") == 0)
+		return CAPTURE_VIDEO;
+	return CAPTURE_PNG;
+}
+
+/*
+ * every buffer and encode buffer is allocated here, capture_frame()
+ * only copies and queues.
+ */
+struct Capture *
+capture_open(const char *path, enum CAPTURE_FORMAT format, enum CAPTURE_POLICY policy, int buffers, int workers) {
+	static const size_t sizes[] = {
+		[CAPTURE_PNG] = PNG_SIZE,
+		[CAPTURE_Y4M] = Y4M_SIZE,
+		[CAPTURE_RAW] = RAW_SIZE,
+		[CAPTURE_VIDEO] = 1,
+	};
+	if (workers < 1)
+		workers = 1;
+	if (workers > CAPTURE_WORKERS)
+		workers = CAPTURE_WORKERS;
+	if (buffers < workers)
+		buffers = workers;
+
+	struct Capture *c = calloc(1, sizeof(*c));
+	c->format = format;
+	c->policy = policy;
+	snprintf(c->path, sizeof(c->path), "%s", path);
+	c->nbuffers = buffers;
+	c->buffers = calloc(buffers, sizeof(c->buffers[0]));
+	c->free = calloc(buffers, sizeof(c->free[0]));
+	c->queue = calloc(buffers, sizeof(c->queue[0]));
+	for (int i = 0; i < buffers; i++) {
+		c->buffers[i].out = malloc(sizes[format]);
+		c->free[c->nfree++] = i;
+	}
+	crc_init();
+
+	if (format == CAPTURE_PNG) {
+		mkdir(path, 0755);
+	} else if (format == CAPTURE_VIDEO) {
+		c->video = video_open(path);
+		if (c->video == NULL) {
+			capture_close(c);
+			return NULL;
+		}
+	} else {
+		c->f = fopen(path, "wb");
+		if (c->f == NULL) {
+			perror(path);
+			c->nworkers = 0;
+			capture_close(c);
+			return NULL;
+		}
+		if (format == CAPTURE_Y4M)
+			fprintf(c->f, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", CAPTURE_WIDTH, CAPTURE_HEIGHT);
+		else
+			fwrite(MAGIC, 1, sizeof(MAGIC), c->f);
+	}
+
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->queued, NULL);
+	pthread_cond_init(&c->freed, NULL);
+	pthread_cond_init(&c->turn, NULL);
+	for (; c->nworkers < workers; c->nworkers++)
+		pthread_create(&c->workers[c->nworkers], NULL, work, c);
+	return c;
+}
+
+// queues a frame of vram, returns 1 if it was dropped
+int
+capture_frame(struct Capture *c, const uint8_t *vram) {
+	pthread_mutex_lock(&c->lock);
+	while (c->nfree == 0) {
+		if (c->policy == CAPTURE_DROP) {
+			c->frame++;
+			c->dropped++;
+			pthread_mutex_unlock(&c->lock);
+			return 1;
+		}
+		pthread_cond_wait(&c->freed, &c->lock);
+	}
+	int i = c->free[--c->nfree];
+	pthread_mutex_unlock(&c->lock);
+
+	struct CaptureBuffer *b = &c->buffers[i];
+	memcpy(b->vram, vram, CAPTURE_VRAM);
+
+	pthread_mutex_lock(&c->lock);
+	b->seq = c->seq++;
+	b->frame = c->frame++;
+	c->queue[(c->qhead + c->qlen++) % c->nbuffers] = i;
+	pthread_cond_signal(&c->queued);
+	pthread_mutex_unlock(&c->lock);
+	return 0;
+}
+
+// waits for every queued frame to be written, nonzero if any failed
+int
+capture_close(struct Capture *c) {
+	if (c == NULL)
+		return 0;
+
+	if (c->nworkers) {
+		pthread_mutex_lock(&c->lock);
+		c->stop = 1;
+		pthread_cond_broadcast(&c->queued);
+		pthread_mutex_unlock(&c->lock);
+		for (int i = 0; i < c->nworkers; i++)
+			pthread_join(c->workers[i], NULL);
+		pthread_mutex_destroy(&c->lock);
+		pthread_cond_destroy(&c->queued);
+		pthread_cond_destroy(&c->freed);
+		pthread_cond_destroy(&c->turn);
+	}
+
+	int failed = c->failed | video_close(c->video);
+	if (c->f && fclose(c->f)) {
+		perror(c->path);
+		failed = 1;
+	}
+	if (c->dropped)
+		fprintf(stderr, "%s: dropped %llu of %llu frames\n", c->path,
+			(unsigned long long)c->dropped, (unsigned long long)c->frame);
+
+	for (int i = 0; i < c->nbuffers; i++)
+		free(c->buffers[i].out);
+	free(c->buffers);
+	free(c->free);
+	free(c->queue);
+	free(c);
+	return failed;
+}
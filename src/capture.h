@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define CAPTURE_VRAM 0x1c00 // 0x2400-0x3fff, packed 1bpp and rotated
+#define CAPTURE_WIDTH 224
+#define CAPTURE_HEIGHT 256
+#define CAPTURE_WORKERS 16
+
+enum CAPTURE_FORMAT {
+	CAPTURE_PNG, // a file per frame in a directory
+	CAPTURE_Y4M, // one stream, for ffmpeg and friends
+	CAPTURE_RAW, // one stream of vram chunks
+	CAPTURE_VIDEO, // a delta coded recording, see video.h
+};
+
+// what capture_frame() does when every buffer is still being encoded
+enum CAPTURE_POLICY {
+	CAPTURE_BLOCK,
+	CAPTURE_DROP,
+};
+
+struct CaptureBuffer {
+	uint64_t seq; // order in the stream
+	uint64_t frame; // frames offered before it, dropped ones included
+	uint8_t vram[CAPTURE_VRAM];
+	uint8_t *out; // encoded
+	size_t len;
+};
+
+/*
+ * the emulation thread copies vram into a free buffer and queues it,
+ * the workers encode buffers in any order and write them out. stream
+ * formats are written in seq order, each worker waiting its turn.
+ */
+struct Capture {
+	enum CAPTURE_FORMAT format;
+	enum CAPTURE_POLICY policy;
+	char path[1024];
+	FILE *f;
+	struct Video *video;
+
+	struct CaptureBuffer *buffers;
+	int nbuffers;
+	int *free; // a stack of buffer indices
+	int nfree;
+	int *queue; // a ring of buffer indices waiting for a worker
+	int qhead;
+	int qlen;
+
+	uint64_t seq;
+	uint64_t frame;
+	uint64_t written; // seq the stream writes next
+	uint64_t dropped;
+	int failed;
+	int stop;
+
+	pthread_mutex_t lock;
+	pthread_cond_t queued;
+	pthread_cond_t freed;
+	pthread_cond_t turn;
+	pthread_t workers[CAPTURE_WORKERS];
+	int nworkers;
+};
+
+enum CAPTURE_FORMAT capture_format(const char *path);
+struct Capture *capture_open(const char *path, enum CAPTURE_FORMAT format, enum CAPTURE_POLICY policy, int buffers, int workers);
+int capture_frame(struct Capture *c, const uint8_t *vram);
+int capture_close(struct Capture *c);
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "analyse.h"
+#include "dissasemble.h"
+#include "coverage.h"
+
+static const char MAGIC[8] = "SIVCOV01";
+
+static int
+covered(const uint8_t *bits, uint16_t adr) {
+	return (bits[adr >> 3] >> (adr & 7)) & 1;
+}
+
+// ors the bitmap in path into bits
+int
+coverage_load(uint8_t *bits, const char *path) {
+	char magic[sizeof(MAGIC)];
+	uint8_t file[COVERAGE_SIZE];
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	size_t ok = fread(magic, sizeof(magic), 1, f);
+	ok += fread(file, sizeof(file), 1, f);
+	fclose(f);
+
+	if (ok != 2 || memcmp(magic, MAGIC, sizeof(MAGIC))) {
+		fprintf(stderr, "%s: not a coverage file\n", path);
+		return 1;
+	}
+	for (int i = 0; i < COVERAGE_SIZE; i++)
+		bits[i] |= file[i];
+	return 0;
+}
+
+/*
+ * ors bits into the file at path, creating it. the file is locked for
+ * the read and write so any number of runs can merge into one at once.
+ */
+int
+coverage_merge(const uint8_t *bits, const char *path) {
+	uint8_t file[sizeof(MAGIC) + COVERAGE_SIZE];
+	struct flock lock = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	if (fcntl(fd, F_SETLKW, &lock)) {
+		perror(path);
+		close(fd);
+		return 1;
+	}
+
+	ssize_t n = read(fd, file, sizeof(file));
+	if (n == 0) {
+		memcpy(file, MAGIC, sizeof(MAGIC));
+		memset(&file[sizeof(MAGIC)], 0, COVERAGE_SIZE);
+	} else if (n != (ssize_t)sizeof(file) || memcmp(file, MAGIC, sizeof(MAGIC))) {
+		fprintf(stderr, "%s: not a coverage file\n", path);
+		close(fd);
+		return 1;
+	}
+
+	for (int i = 0; i < COVERAGE_SIZE; i++)
+		file[sizeof(MAGIC) + i] |= bits[i];
+
+	int failed = pwrite(fd, file, sizeof(file), 0) != (ssize_t)sizeof(file);
+	if (failed)
+		perror(path);
+	close(fd); // drops the lock
+	return failed;
+}
+
+/*
+ * how much of the code the analyser found was executed, then every run
+ * of instructions that never was, disassembled. addresses executed that
+ * the analyser did not find as code, reached through PCHL or data, are
+ * counted separately.
+ */
+void
+coverage_report(const uint8_t *bits, const uint8_t *rom, const struct Analysis *an, FILE *f) {
+	char line[DISASM_MAX];
+	int instructions = 0;
+	int executed = 0;
+	int outside = 0;
+
+	for (int adr = 0; adr < ROM_SIZE; adr++) {
+		if (an->kind[adr] == BYTE_CODE) {
+			instructions++;
+			executed += covered(bits, adr);
+		} else if (covered(bits, adr)) {
+			outside++;
+		}
+	}
+	fprintf(f, "; %d of %d instructions executed (%.1f%%), %d more executed outside the analysed code\n",
+		executed, instructions, instructions ? 100.0 * executed / instructions : 0.0, outside);
+
+	for (int i = 0; i < an->nblocks; i++) {
+		const struct Block *b = &an->blocks[i];
+		int open = 0;
+		for (uint16_t pc = b->start; pc < b->end;) {
+			int len = disassemble_line(&rom[pc], pc, line);
+			if (!covered(bits, pc)) {
+				if (!open)
+					fprintf(f, "\nnever executed in block %04x-%04x\n", b->start, b->end - 1);
+				open = 1;
+				fprintf(f, "\t%s\n", line);
+			}
+			pc += len;
+		}
+	}
+}
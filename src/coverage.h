@@ -0,0 +1,10 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#define COVERAGE_SIZE (0x10000 / 8)
+
+struct Analysis;
+
+int coverage_load(uint8_t *bits, const char *path);
+int coverage_merge(const uint8_t *bits, const char *path);
+void coverage_report(const uint8_t *bits, const uint8_t *rom, const struct Analysis *an, FILE *f);
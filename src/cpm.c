@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "cpm.h"
+
+int
+cpm_init(struct CPM *cpm, char *filename) {
+	memset(cpm, 0, sizeof(*cpm));
+
+	FILE *f = fopen(filename, "r");
+	if (f == NULL) {
+		perror(filename);
+		return 1;
+	}
+
+	cpm->emulate = emulate;
+	cpm->image = calloc(0x10000, 1);
+	cpm->cpu.ram = calloc(0x10000, 1);
+	fread(&cpm->image[0x100], sizeof(uint8_t), 0x10000 - 0x100, f);
+	fclose(f);
+
+	memset(cpm->restore, 0xff, sizeof(cpm->restore));
+	cpm_restart(cpm);
+	return 0;
+}
+
+void
+cpm_restart(struct CPM *cpm) {
+	uint8_t *ram = cpm->cpu.ram;
+
+	for (int page = 0; page < 256; page++) {
+		if (cpm->restore[page >> 5] >> (page & 31) & 1)
+			memcpy(&ram[page << 8], &cpm->image[page << 8], 256);
+	}
+	memset(&cpm->cpu, 0, sizeof(cpm->cpu));
+	cpm->cpu.ram = ram;
+	cpm->cpu.pc = 0x100;
+	cpm->len = 0;
+	cpm->done = 0;
+}
+
+/*
+ * after a run, limits cpm_restart() to the pages that run changed. only
+ * for programs that write the same pages every time, like cpudiag.
+ */
+void
+cpm_restore_changed(struct CPM *cpm) {
+	memset(cpm->restore, 0, sizeof(cpm->restore));
+	for (int page = 0; page < 256; page++) {
+		if (memcmp(&cpm->cpu.ram[page << 8], &cpm->image[page << 8], 256))
+			cpm->restore[page >> 5] |= 1u << (page & 31);
+	}
+}
+
+void
+cpm_free(struct CPM *cpm) {
+	free(cpm->image);
+	free(cpm->cpu.ram);
+}
+
+static void
+put(struct CPM *cpm, char c) {
+	if (cpm->len < (int)sizeof(cpm->out) - 1) {
+		cpm->out[cpm->len++] = c;
+		cpm->out[cpm->len] = '\0';
+	}
+	if (cpm->echo)
+		putchar(c);
+}
+
+// function 2 prints the character in E, function 9 the string at DE up to '$'
+static void
+bdos(struct CPM *cpm) {
+	struct CPU *cpu = &cpm->cpu;
+
+	if (cpu->c == 2) {
+		put(cpm, cpu->e);
+	} else if (cpu->c == 9) {
+		for (uint16_t adr = cpu->d << 8 | cpu->e; cpu->ram[adr] != '$'; adr++)
+			put(cpm, cpu->ram[adr]);
+	}
+
+	cpu->pc = cpu->ram[(uint16_t)(cpu->sp + 1)] << 8 | cpu->ram[cpu->sp];
+	cpu->sp += 2;
+}
+
+// one instruction or BDOS call, returns the cycles it took
+int
+cpm_step(struct CPM *cpm) {
+	switch (cpm->cpu.pc) {
+		case 0x0000:
+			cpm->done = 1;
+			return 0;
+		case 0x0005:
+			bdos(cpm);
+			return cycles8080[0xc9];
+		default:
+			return cpm->emulate(&cpm->cpu);
+	}
+}
@@ -0,0 +1,23 @@
+#include <stdint.h>
+
+/*
+ * just enough CP/M to run test programs like cpudiag.bin: the program is
+ * loaded at 0x100, BDOS calls at 0x0005 print through out, and a jump to
+ * the warm boot vector at 0x0000 ends the run.
+ */
+struct CPM {
+	struct CPU cpu;
+	emulate_fn emulate; // variant cpm_step() runs, emulate by default
+	uint8_t *image; // memory as loaded, for cpm_restart()
+	uint32_t restore[8]; // the 256 byte pages cpm_restart() copies back, all of them by default
+	char out[1024];
+	int len;
+	int echo; // also print BDOS output to stdout
+	int done;
+};
+
+int cpm_init(struct CPM *cpm, char *filename);
+void cpm_restart(struct CPM *cpm);
+void cpm_restore_changed(struct CPM *cpm);
+void cpm_free(struct CPM *cpm);
+int cpm_step(struct CPM *cpm);
@@ -2,12 +2,19 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+// 8k ROM + 1k RAM + 7k Video RAM + 1K Ram mirror
+#define MEMORY_SIZE ((8 + 1 + 7 + 1) * 1024)
+#define RAM_ALIGN 4096 // map() allocates ram in pages of this size
+#define RAM_ALLOC ((MEMORY_SIZE + RAM_ALIGN - 1) / RAM_ALIGN * RAM_ALIGN)
+#define CORE_VERSION 1 // bump when emulate() behaves differently, cached state goes stale
+
 enum FLAGS {
 	CARRY = 0x01,
 	PARITY = 0x01 << 2,
+	AUX = 0x01 << 4,
 	ZERO = 0x01 << 6,
 	SIGN = 0x01 << 7,
-	ALL = CARRY | PARITY | ZERO | SIGN,
+	ALL = CARRY | PARITY | AUX | ZERO | SIGN,
 };
 
 struct Flags {
@@ -38,9 +45,34 @@ struct CPU {
 	uint8_t *iports[4]; // pointers to iports
 	uint8_t *oports[7]; // pointers to oports
 	uint8_t shift_written;
+	uint8_t sound_written; // port 3 or 5, cleared by whoever consumes it
+	uint8_t interrupting; // while generate_interrupt() pushes pc, for watch.c
+	uint32_t dirty[8]; // one bit per 256 byte page written by emulate_dirty() or an interrupt
 };
 
+typedef int (*emulate_fn)(struct CPU *cpu);
+
+// debug_flags bits, checked by emulate_debug() before each instruction
+enum DEBUG_FLAGS {
+	DEBUG_BREAK = 0x01,
+	DEBUG_STEP = 0x02, // on every address while single stepping
+	DEBUG_OVER = 0x04, // the return address of a call being stepped over
+};
+
+extern unsigned char cycles8080[];
+extern uint8_t debug_flags[0x10000];
+extern uint8_t coverage[0x10000 / 8]; // one bit per address fetched by emulate_coverage()
+extern void (*debug_hook)(struct CPU *cpu); // before a flagged instruction, which runs once it returns
+extern void (*trace_hook)(struct CPU *cpu, uint16_t pc, int cycles); // after each instruction at pc
+
 int map(struct CPU *cpu, FILE *f);
 int emulate(struct CPU *cpu);
+int emulate_traced(struct CPU *cpu);
+int emulate_profiled(struct CPU *cpu);
+int emulate_debug(struct CPU *cpu);
+int emulate_coverage(struct CPU *cpu);
+int emulate_dirty(struct CPU *cpu);
+emulate_fn emulate_variant(const char *name);
+uint8_t get_psw(struct Flags *flags);
 void print_cpu_state(struct CPU *cpu, int cycles);
 void generate_interrupt(struct CPU *cpu, int interrupt_num);
@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "machine.h"
+#include "dissasemble.h"
+#include "watch.h"
+#include "debugger.h"
+
+static struct Debugger *active; // debug_hook has no argument of its own
+
+// emulate_debug() while anything is armed, the machine's own variant otherwise
+static void
+arm(struct Debugger *d) {
+	int armed = d->breakpoints || d->stepping || d->over >= 0;
+	d->machine->emulate = armed ? emulate_debug : d->run;
+}
+
+static void
+step_all(struct Debugger *d, int on) {
+	for (int i = 0; i < 0x10000; i++)
+		debug_flags[i] = on ? debug_flags[i] | DEBUG_STEP : debug_flags[i] & ~DEBUG_STEP;
+	d->stepping = on;
+}
+
+static uint8_t
+peek(struct CPU *cpu, uint16_t adr) {
+	return adr < MEMORY_SIZE ? cpu->ram[adr] : 0;
+}
+
+static void
+registers(struct Debugger *d) {
+	struct CPU *cpu = d->machine->cpu;
+
+	fprintf(d->out, "a %02x  bc %02x%02x  de %02x%02x  hl %02x%02x  sp %04x  pc %04x  %c%c%c%c%c  (hl) %02x  (sp) %02x%02x\n",
+		cpu->a, cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l, cpu->sp, cpu->pc,
+		cpu->flags.s ? 's' : '-', cpu->flags.z ? 'z' : '-', cpu->flags.a ? 'a' : '-',
+		cpu->flags.p ? 'p' : '-', cpu->flags.c ? 'c' : '-',
+		peek(cpu, cpu->h << 8 | cpu->l), peek(cpu, cpu->sp + 1), peek(cpu, cpu->sp));
+}
+
+// count instructions from adr through get_opname(), which prints to stdout
+static uint16_t
+list(struct Debugger *d, uint16_t adr, int count) {
+	struct CPU *cpu = d->machine->cpu;
+
+	fflush(d->out);
+	for (int i = 0; i < count && adr < MEMORY_SIZE - 2; i++) {
+		printf("%c", debug_flags[adr] & DEBUG_BREAK ? '*' : adr == cpu->pc ? '>' : ' ');
+		adr += get_opname(cpu->ram, adr);
+	}
+	fflush(stdout);
+	return adr;
+}
+
+static void
+dump(struct Debugger *d, uint16_t adr, int len) {
+	for (int i = 0; i < len; i += 16) {
+		fprintf(d->out, "%04x ", (uint16_t)(adr + i));
+		for (int j = i; j < i + 16 && j < len; j++) {
+			uint16_t a = adr + j;
+			if (a < MEMORY_SIZE)
+				fprintf(d->out, " %02x", d->machine->cpu->ram[a]);
+			else
+				fprintf(d->out, " --");
+		}
+		fprintf(d->out, "\n");
+	}
+}
+
+static void
+breakpoint(struct Debugger *d, long adr, int on) {
+	if (adr < 0 || adr > 0xffff) {
+		for (int i = 0, n = 0; i < 0x10000; i++) {
+			if (debug_flags[i] & DEBUG_BREAK)
+				fprintf(d->out, "%s%04x", n++ ? " " : "", i);
+		}
+		fprintf(d->out, d->breakpoints ? "\n" : "no breakpoints\n");
+		return;
+	}
+	if (!(debug_flags[adr] & DEBUG_BREAK) == !on)
+		return;
+	debug_flags[adr] ^= DEBUG_BREAK;
+	d->breakpoints += on ? 1 : -1;
+}
+
+// CALL, the conditional calls and RST, which step over stops after
+static int
+is_call(uint8_t op) {
+	return op == 0xcd || (op & 0xc7) == 0xc4 || (op & 0xc7) == 0xc7;
+}
+
+// the prompt, until a command lets the instruction at pc run
+static void
+prompt(struct Debugger *d) {
+	struct CPU *cpu = d->machine->cpu;
+	char line[64];
+
+	watch_report(d->out);
+	registers(d);
+	list(d, cpu->pc, 1);
+	for (;;) {
+		fprintf(d->out, "(dbg) ");
+		fflush(d->out);
+		if (fgets(line, sizeof(line), d->in) == NULL)
+			strcpy(line, "c\n"); // no more input, let it run
+		if (line[0] == '\n')
+			strcpy(line, d->last);
+		else
+			strcpy(d->last, line);
+
+		char cmd[8] = "";
+		unsigned long x, y;
+		int n = sscanf(line, "%7s %lx %lx", cmd, &x, &y);
+		long a = n > 1 ? (long)(x & 0xffff) : -1;
+		long b = n > 2 ? (long)y : -1;
+
+		switch (cmd[0]) {
+			case 's': // step into
+				step_all(d, 1);
+				arm(d);
+				return;
+			case 'n': // step over calls
+				if (is_call(cpu->ram[cpu->pc])) {
+					d->over = (cpu->pc + disassemble_length(cpu->ram[cpu->pc])) & 0xffff;
+					debug_flags[d->over] |= DEBUG_OVER;
+				} else {
+					step_all(d, 1);
+				}
+				arm(d);
+				return;
+			case 'c': // continue
+				arm(d);
+				return;
+			case 'b':
+				breakpoint(d, a, 1);
+				break;
+			case 'd':
+				breakpoint(d, a, 0);
+				break;
+			case 'r':
+				registers(d);
+				break;
+			case 'w':
+				if (a < 0)
+					watch_list(d->out);
+				else if (watch_open(cpu) == 0 && watch_add(a, b < 0 ? a : b))
+					fprintf(d->out, "can't watch that\n");
+				break;
+			case 'u':
+				if (a < 0 || watch_remove(a))
+					fprintf(d->out, "no watchpoint there\n");
+				break;
+			case 'x':
+				dump(d, a < 0 ? cpu->h << 8 | cpu->l : a, b < 0 ? 64 : b);
+				break;
+			case 'l':
+				list(d, a < 0 ? cpu->pc : a, b < 0 ? 10 : b);
+				break;
+			case 'q':
+				exit(0);
+			default:
+				fprintf(d->out,
+					"s step, n step over, c continue, b [adr] break or list, d adr delete,\n"
+					"r registers, x [adr] [len] memory (hl), l [adr] [count] disassemble (pc),\n"
+					"w [adr] [end] watch writes or list, u adr unwatch, q quit\n"
+					"addresses and counts in hex\n");
+		}
+	}
+}
+
+// stops when pc has a breakpoint, the step flag, or is where a stepped over call returns
+static void
+hook(struct CPU *cpu) {
+	struct Debugger *d = active;
+	uint8_t flags = debug_flags[cpu->pc];
+
+	if (d == NULL || !(flags & (DEBUG_BREAK | DEBUG_STEP | DEBUG_OVER)))
+		return;
+	if (d->stepping)
+		step_all(d, 0);
+	if (d->over >= 0) {
+		debug_flags[d->over] &= ~DEBUG_OVER;
+		d->over = -1;
+	}
+	arm(d);
+	prompt(d);
+	// a ctrl-c typed at the prompt is not a request to stop again
+	if (d->interrupted)
+		*d->interrupted = 0;
+}
+
+void
+debugger_open(struct Debugger *d, struct Machine *machine, FILE *in, FILE *out) {
+	memset(d, 0, sizeof(*d));
+	d->machine = machine;
+	d->run = machine->emulate;
+	d->over = -1;
+	d->in = in;
+	d->out = out;
+	strcpy(d->last, "s\n");
+	active = d;
+	debug_hook = hook;
+}
+
+// clears every flag and gives the machine its own variant back
+void
+debugger_close(struct Debugger *d) {
+	memset(debug_flags, 0, sizeof(debug_flags));
+	d->machine->emulate = d->run;
+	if (active == d) {
+		active = NULL;
+		debug_hook = NULL;
+	}
+}
+
+// stops before the next instruction, safe to call between emulate() calls
+void
+debugger_break(struct Debugger *d) {
+	step_all(d, 1);
+	arm(d);
+}
@@ -0,0 +1,26 @@
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * a console debugger for one machine. it swaps machine->emulate for
+ * emulate_debug() only while a breakpoint or a step is armed, the rest of
+ * the time the machine runs its own variant at full speed. an
+ * instrumented variant counts nothing while it is swapped out, so the
+ * emulator only debugs the plain one.
+ */
+struct Debugger {
+	struct Machine *machine;
+	emulate_fn run; // the variant used while nothing is armed
+	int breakpoints; // addresses with DEBUG_BREAK
+	int over; // address with DEBUG_OVER, -1 for none
+	int stepping; // DEBUG_STEP is set on every address
+	FILE *in;
+	FILE *out;
+	char last[64]; // repeated on an empty line
+	volatile sig_atomic_t *interrupted; // a break request, cleared whenever the prompt lets go
+};
+
+void debugger_open(struct Debugger *d, struct Machine *machine, FILE *in, FILE *out);
+void debugger_close(struct Debugger *d);
+void debugger_break(struct Debugger *d);
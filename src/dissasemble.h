@@ -1 +1,10 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#define DISASM_MAX 24 // longest line disassemble_line() writes, terminator included
+
+int disassemble(const uint8_t *op, char *out);
+int disassemble_length(uint8_t op);
+int disassemble_line(const uint8_t *op, uint16_t pc, char *out);
+size_t disassemble_range(const uint8_t *code, uint16_t start, uint16_t end, char *out, size_t size);
 int get_opname(unsigned char *buf, int pc);
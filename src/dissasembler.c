@@ -1,296 +1,345 @@
+#include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
 
-int
-get_opname(unsigned char *buf, int pc)
-{
-	int bytes = 1;
-	printf("%04x ", pc);
-	unsigned char *opcode = &buf[pc];
-	switch (*opcode) {
-		case 0x00: printf("NOP"); break;
-		case 0x01: printf("LXI  B,$%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x02: printf("STAX B"); break;
-		case 0x03: printf("INX  B"); break;
-		case 0x04: printf("INR  B"); break;
-		case 0x05: printf("DCR  B"); break;
-		case 0x06: printf("MVI  B,$%02x", opcode[1]); bytes = 2; break;
-		case 0x07: printf("RLC"); break;
-		case 0x08: printf("0x08 ILLEGAL"); break;
-		case 0x09: printf("DAD  B"); break;
-		case 0x0a: printf("LDAX B"); break;
-		case 0x0b: printf("DCX  B"); break;
-		case 0x0c: printf("INC  C"); break;
-		case 0x0d: printf("DCR  C"); break;
-		case 0x0e: printf("MVI  C,$%02x", opcode[1]); bytes = 2; break;
-		case 0x0f: printf("RRC"); break;
-		case 0x10: printf("0x10 ILLEGAL"); break;
-
-		case 0x11: printf("LXI  D,$%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x12: printf("STAX D"); break;
-		case 0x13: printf("INX  D"); break;
-		case 0x14: printf("INR  D"); break;
-		case 0x15: printf("DCR  D"); break;
-		case 0x16: printf("MVI  D,$%02x", opcode[1]); bytes = 2; break;
-		case 0x17: printf("RAL"); break;
-		case 0x18: printf("0x18 ILLEGAL"); break;
-		case 0x19: printf("DAD  D"); break;
-		case 0x1a: printf("LDAX D"); break;
-		case 0x1b: printf("DCX  D"); break;
-		case 0x1c: printf("INC  E"); break;
-		case 0x1d: printf("DCR  E"); break;
-		case 0x1e: printf("MVI  E,$%02x", opcode[1]); bytes = 2; break;
-		case 0x1f: printf("RAR"); break;
-		case 0x20: printf("0x20 ILLEGAL"); break;
-
-		case 0x21: printf("LXI  H,$%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x22: printf("SHLD $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x23: printf("INX  H"); break;
-		case 0x24: printf("INR  H"); break;
-		case 0x25: printf("DCR  H"); break;
-		case 0x26: printf("MVI  H,$%02x", opcode[1]); bytes = 2; break;
-		case 0x27: printf("DAA"); break;
-		case 0x28: printf("0x28 ILLEGAL"); break;
-		case 0x29: printf("DAD  H"); break;
-		case 0x2a: printf("LHLD $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x2b: printf("DCX  H"); break;
-		case 0x2c: printf("INC  L"); break;
-		case 0x2d: printf("DCR  L"); break;
-		case 0x2e: printf("MVI  L,$%02x", opcode[1]); bytes = 2; break;
-		case 0x2f: printf("CMA"); break;
-		case 0x30: printf("0x30 ILLEGAL"); break;
-
-		case 0x31: printf("LXI  SP $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x32: printf("STA $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x33: printf("INX  SP"); break;
-		case 0x34: printf("INR  M"); break;
-		case 0x35: printf("DCR  M"); break;
-		case 0x36: printf("MVI  M,$%02x", opcode[1]); bytes = 2; break;
-		case 0x37: printf("STC"); break;
-		case 0x38: printf("0x38 ILLEGAL"); break;
-		case 0x39: printf("DAD  SP"); break;
-		case 0x3a: printf("LDA $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0x3b: printf("DCX  SP"); break;
-		case 0x3c: printf("INC  A"); break;
-		case 0x3d: printf("DCR  A"); break;
-		case 0x3e: printf("MVI  A,$%02x", opcode[1]); bytes = 2; break;
-		case 0x3f: printf("CMC"); break;
-
-		case 0x40: printf("MOV B,B"); break;
-		case 0x41: printf("MOV B,C"); break;
-		case 0x42: printf("MOV B,D"); break;
-		case 0x43: printf("MOV B,E"); break;
-		case 0x44: printf("MOV B,H"); break;
-		case 0x45: printf("MOV B,L"); break;
-		case 0x46: printf("MOV B,M"); break;
-		case 0x47: printf("MOV B,A"); break;
-
-		case 0x48: printf("MOV C,B"); break;
-		case 0x49: printf("MOV C,C"); break;
-		case 0x4a: printf("MOV C,D"); break;
-		case 0x4b: printf("MOV C,E"); break;
-		case 0x4c: printf("MOV C,H"); break;
-		case 0x4d: printf("MOV C,L"); break;
-		case 0x4e: printf("MOV C,M"); break;
-		case 0x4f: printf("MOV C,A"); break;
-
-		case 0x50: printf("MOV D,B"); break;
-		case 0x51: printf("MOV D,C"); break;
-		case 0x52: printf("MOV D,D"); break;
-		case 0x53: printf("MOV D,E"); break;
-		case 0x54: printf("MOV D,H"); break;
-		case 0x55: printf("MOV D,L"); break;
-		case 0x56: printf("MOV D,M"); break;
-		case 0x57: printf("MOV D,A"); break;
-
-		case 0x58: printf("MOV E,B"); break;
-		case 0x59: printf("MOV E,C"); break;
-		case 0x5a: printf("MOV E,D"); break;
-		case 0x5b: printf("MOV E,E"); break;
-		case 0x5c: printf("MOV E,H"); break;
-		case 0x5d: printf("MOV E,L"); break;
-		case 0x5e: printf("MOV E,M"); break;
-		case 0x5f: printf("MOV E,A"); break;
-
-		case 0x60: printf("MOV H,B"); break;
-		case 0x61: printf("MOV H,C"); break;
-		case 0x62: printf("MOV H,D"); break;
-		case 0x63: printf("MOV H,E"); break;
-		case 0x64: printf("MOV H,H"); break;
-		case 0x65: printf("MOV H,L"); break;
-		case 0x66: printf("MOV H,M"); break;
-		case 0x67: printf("MOV H,A"); break;
-
-		case 0x68: printf("MOV L,B"); break;
-		case 0x69: printf("MOV L,C"); break;
-		case 0x6a: printf("MOV L,D"); break;
-		case 0x6b: printf("MOV L,E"); break;
-		case 0x6c: printf("MOV L,H"); break;
-		case 0x6d: printf("MOV L,L"); break;
-		case 0x6e: printf("MOV L,M"); break;
-		case 0x6f: printf("MOV L,A"); break;
-
-		case 0x70: printf("MOV M,B"); break;
-		case 0x71: printf("MOV M,C"); break;
-		case 0x72: printf("MOV M,D"); break;
-		case 0x73: printf("MOV M,E"); break;
-		case 0x74: printf("MOV M,H"); break;
-		case 0x75: printf("MOV M,L"); break;
-
-		case 0x76: printf("HLT"); break;
-		case 0x77: printf("MOV M,A"); break;
-		case 0x78: printf("MOV A,B"); break;
-		case 0x79: printf("MOV A,C"); break;
-		case 0x7a: printf("MOV A,D"); break;
-		case 0x7b: printf("MOV A,E"); break;
-		case 0x7c: printf("MOV A,H"); break;
-		case 0x7d: printf("MOV A,L"); break;
-		case 0x7e: printf("MOV A,M"); break;
-		case 0x7f: printf("MOV A,H"); break;
-
-		case 0x80: printf("ADD B"); break;
-		case 0x81: printf("ADD C"); break;
-		case 0x82: printf("ADD D"); break;
-		case 0x83: printf("ADD E"); break;
-		case 0x84: printf("ADD H"); break;
-		case 0x85: printf("ADD L"); break;
-		case 0x86: printf("ADD M"); break;
-		case 0x87: printf("ADD A"); break;
-
-		case 0x88: printf("ADC B"); break;
-		case 0x89: printf("ADC C"); break;
-		case 0x8a: printf("ADC D"); break;
-		case 0x8b: printf("ADC E"); break;
-		case 0x8c: printf("ADC H"); break;
-		case 0x8d: printf("ADC L"); break;
-		case 0x8e: printf("ADC M"); break;
-		case 0x8f: printf("ADC A"); break;
+#include "dissasemble.h"
 
-		case 0x90: printf("SUB B"); break;
-		case 0x91: printf("SUB C"); break;
-		case 0x92: printf("SUB D"); break;
-		case 0x93: printf("SUB E"); break;
-		case 0x94: printf("SUB H"); break;
-		case 0x95: printf("SUB L"); break;
-		case 0x96: printf("SUB M"); break;
-		case 0x97: printf("SUB A"); break;
+// text up to the operand, which is printed in hex after it, and length
+static const struct {
+	const char *text;
+	uint8_t bytes;
+} table[256] = {
+	{ "NOP", 1 }, // 00
+	{ "LXI  B,$", 3 }, // 01
+	{ "STAX B", 1 }, // 02
+	{ "INX  B", 1 }, // 03
+	{ "INR  B", 1 }, // 04
+	{ "DCR  B", 1 }, // 05
+	{ "MVI  B,$", 2 }, // 06
+	{ "RLC", 1 }, // 07
+	{ "0x08 ILLEGAL", 1 }, // 08
+	{ "DAD  B", 1 }, // 09
+	{ "LDAX B", 1 }, // 0a
+	{ "DCX  B", 1 }, // 0b
+	{ "INC  C", 1 }, // 0c
+	{ "DCR  C", 1 }, // 0d
+	{ "MVI  C,$", 2 }, // 0e
+	{ "RRC", 1 }, // 0f
+	{ "0x10 ILLEGAL", 1 }, // 10
+	{ "LXI  D,$", 3 }, // 11
+	{ "STAX D", 1 }, // 12
+	{ "INX  D", 1 }, // 13
+	{ "INR  D", 1 }, // 14
+	{ "DCR  D", 1 }, // 15
+	{ "MVI  D,$", 2 }, // 16
+	{ "RAL", 1 }, // 17
+	{ "0x18 ILLEGAL", 1 }, // 18
+	{ "DAD  D", 1 }, // 19
+	{ "LDAX D", 1 }, // 1a
+	{ "DCX  D", 1 }, // 1b
+	{ "INC  E", 1 }, // 1c
+	{ "DCR  E", 1 }, // 1d
+	{ "MVI  E,$", 2 }, // 1e
+	{ "RAR", 1 }, // 1f
+	{ "0x20 ILLEGAL", 1 }, // 20
+	{ "LXI  H,$", 3 }, // 21
+	{ "SHLD $", 3 }, // 22
+	{ "INX  H", 1 }, // 23
+	{ "INR  H", 1 }, // 24
+	{ "DCR  H", 1 }, // 25
+	{ "MVI  H,$", 2 }, // 26
+	{ "DAA", 1 }, // 27
+	{ "0x28 ILLEGAL", 1 }, // 28
+	{ "DAD  H", 1 }, // 29
+	{ "LHLD $", 3 }, // 2a
+	{ "DCX  H", 1 }, // 2b
+	{ "INC  L", 1 }, // 2c
+	{ "DCR  L", 1 }, // 2d
+	{ "MVI  L,$", 2 }, // 2e
+	{ "CMA", 1 }, // 2f
+	{ "0x30 ILLEGAL", 1 }, // 30
+	{ "LXI  SP $", 3 }, // 31
+	{ "STA $", 3 }, // 32
+	{ "INX  SP", 1 }, // 33
+	{ "INR  M", 1 }, // 34
+	{ "DCR  M", 1 }, // 35
+	{ "MVI  M,$", 2 }, // 36
+	{ "STC", 1 }, // 37
+	{ "0x38 ILLEGAL", 1 }, // 38
+	{ "DAD  SP", 1 }, // 39
+	{ "LDA $", 3 }, // 3a
+	{ "DCX  SP", 1 }, // 3b
+	{ "INC  A", 1 }, // 3c
+	{ "DCR  A", 1 }, // 3d
+	{ "MVI  A,$", 2 }, // 3e
+	{ "CMC", 1 }, // 3f
+	{ "MOV B,B", 1 }, // 40
+	{ "MOV B,C", 1 }, // 41
+	{ "MOV B,D", 1 }, // 42
+	{ "MOV B,E", 1 }, // 43
+	{ "MOV B,H", 1 }, // 44
+	{ "MOV B,L", 1 }, // 45
+	{ "MOV B,M", 1 }, // 46
+	{ "MOV B,A", 1 }, // 47
+	{ "MOV C,B", 1 }, // 48
+	{ "MOV C,C", 1 }, // 49
+	{ "MOV C,D", 1 }, // 4a
+	{ "MOV C,E", 1 }, // 4b
+	{ "MOV C,H", 1 }, // 4c
+	{ "MOV C,L", 1 }, // 4d
+	{ "MOV C,M", 1 }, // 4e
+	{ "MOV C,A", 1 }, // 4f
+	{ "MOV D,B", 1 }, // 50
+	{ "MOV D,C", 1 }, // 51
+	{ "MOV D,D", 1 }, // 52
+	{ "MOV D,E", 1 }, // 53
+	{ "MOV D,H", 1 }, // 54
+	{ "MOV D,L", 1 }, // 55
+	{ "MOV D,M", 1 }, // 56
+	{ "MOV D,A", 1 }, // 57
+	{ "MOV E,B", 1 }, // 58
+	{ "MOV E,C", 1 }, // 59
+	{ "MOV E,D", 1 }, // 5a
+	{ "MOV E,E", 1 }, // 5b
+	{ "MOV E,H", 1 }, // 5c
+	{ "MOV E,L", 1 }, // 5d
+	{ "MOV E,M", 1 }, // 5e
+	{ "MOV E,A", 1 }, // 5f
+	{ "MOV H,B", 1 }, // 60
+	{ "MOV H,C", 1 }, // 61
+	{ "MOV H,D", 1 }, // 62
+	{ "MOV H,E", 1 }, // 63
+	{ "MOV H,H", 1 }, // 64
+	{ "MOV H,L", 1 }, // 65
+	{ "MOV H,M", 1 }, // 66
+	{ "MOV H,A", 1 }, // 67
+	{ "MOV L,B", 1 }, // 68
+	{ "MOV L,C", 1 }, // 69
+	{ "MOV L,D", 1 }, // 6a
+	{ "MOV L,E", 1 }, // 6b
+	{ "MOV L,H", 1 }, // 6c
+	{ "MOV L,L", 1 }, // 6d
+	{ "MOV L,M", 1 }, // 6e
+	{ "MOV L,A", 1 }, // 6f
+	{ "MOV M,B", 1 }, // 70
+	{ "MOV M,C", 1 }, // 71
+	{ "MOV M,D", 1 }, // 72
+	{ "MOV M,E", 1 }, // 73
+	{ "MOV M,H", 1 }, // 74
+	{ "MOV M,L", 1 }, // 75
+	{ "HLT", 1 }, // 76
+	{ "MOV M,A", 1 }, // 77
+	{ "MOV A,B", 1 }, // 78
+	{ "MOV A,C", 1 }, // 79
+	{ "MOV A,D", 1 }, // 7a
+	{ "MOV A,E", 1 }, // 7b
+	{ "MOV A,H", 1 }, // 7c
+	{ "MOV A,L", 1 }, // 7d
+	{ "MOV A,M", 1 }, // 7e
+	{ "MOV A,H", 1 }, // 7f
+	{ "ADD B", 1 }, // 80
+	{ "ADD C", 1 }, // 81
+	{ "ADD D", 1 }, // 82
+	{ "ADD E", 1 }, // 83
+	{ "ADD H", 1 }, // 84
+	{ "ADD L", 1 }, // 85
+	{ "ADD M", 1 }, // 86
+	{ "ADD A", 1 }, // 87
+	{ "ADC B", 1 }, // 88
+	{ "ADC C", 1 }, // 89
+	{ "ADC D", 1 }, // 8a
+	{ "ADC E", 1 }, // 8b
+	{ "ADC H", 1 }, // 8c
+	{ "ADC L", 1 }, // 8d
+	{ "ADC M", 1 }, // 8e
+	{ "ADC A", 1 }, // 8f
+	{ "SUB B", 1 }, // 90
+	{ "SUB C", 1 }, // 91
+	{ "SUB D", 1 }, // 92
+	{ "SUB E", 1 }, // 93
+	{ "SUB H", 1 }, // 94
+	{ "SUB L", 1 }, // 95
+	{ "SUB M", 1 }, // 96
+	{ "SUB A", 1 }, // 97
+	{ "SBB B", 1 }, // 98
+	{ "SBB C", 1 }, // 99
+	{ "SBB D", 1 }, // 9a
+	{ "SBB E", 1 }, // 9b
+	{ "SBB H", 1 }, // 9c
+	{ "SBB L", 1 }, // 9d
+	{ "SBB M", 1 }, // 9e
+	{ "SBB A", 1 }, // 9f
+	{ "ANA B", 1 }, // a0
+	{ "ANA C", 1 }, // a1
+	{ "ANA D", 1 }, // a2
+	{ "ANA E", 1 }, // a3
+	{ "ANA H", 1 }, // a4
+	{ "ANA L", 1 }, // a5
+	{ "ANA M", 1 }, // a6
+	{ "ANA A", 1 }, // a7
+	{ "XRA B", 1 }, // a8
+	{ "XRA C", 1 }, // a9
+	{ "XRA D", 1 }, // aa
+	{ "XRA E", 1 }, // ab
+	{ "XRA H", 1 }, // ac
+	{ "XRA L", 1 }, // ad
+	{ "XRA M", 1 }, // ae
+	{ "XRA A", 1 }, // af
+	{ "ORA B", 1 }, // b0
+	{ "ORA C", 1 }, // b1
+	{ "ORA D", 1 }, // b2
+	{ "ORA E", 1 }, // b3
+	{ "ORA H", 1 }, // b4
+	{ "ORA L", 1 }, // b5
+	{ "ORA M", 1 }, // b6
+	{ "ORA A", 1 }, // b7
+	{ "CMP B", 1 }, // b8
+	{ "CMP C", 1 }, // b9
+	{ "CMP D", 1 }, // ba
+	{ "CMP E", 1 }, // bb
+	{ "CMP H", 1 }, // bc
+	{ "CMP L", 1 }, // bd
+	{ "CMP M", 1 }, // be
+	{ "CMP A", 1 }, // bf
+	{ "RNZ", 1 }, // c0
+	{ "POP B", 1 }, // c1
+	{ "JNZ $", 3 }, // c2
+	{ "JMP $", 3 }, // c3
+	{ "CNZ $", 3 }, // c4
+	{ "PUSH B", 1 }, // c5
+	{ "ADI $", 2 }, // c6
+	{ "RST 0", 1 }, // c7
+	{ "RZ", 1 }, // c8
+	{ "RET", 1 }, // c9
+	{ "JZ $", 3 }, // ca
+	{ "0xcb ILLEGAL", 1 }, // cb
+	{ "CZ $", 3 }, // cc
+	{ "CALL $", 3 }, // cd
+	{ "ACI $", 2 }, // ce
+	{ "RST 1", 1 }, // cf
+	{ "RNC", 1 }, // d0
+	{ "POP D", 1 }, // d1
+	{ "JNC $", 3 }, // d2
+	{ "OUT $", 2 }, // d3
+	{ "CNC $", 3 }, // d4
+	{ "PUSH D", 1 }, // d5
+	{ "SUI $", 2 }, // d6
+	{ "RST 2", 1 }, // d7
+	{ "RC", 1 }, // d8
+	{ "0xd9 ILLEGAL", 1 }, // d9
+	{ "JC $", 3 }, // da
+	{ "IN $", 2 }, // db
+	{ "CC $", 3 }, // dc
+	{ "0xdd ILLEGAL", 1 }, // dd
+	{ "SBI $", 2 }, // de
+	{ "RST 3", 1 }, // df
+	{ "RPO", 1 }, // e0
+	{ "POP H", 1 }, // e1
+	{ "JPO $", 3 }, // e2
+	{ "XTHL", 1 }, // e3
+	{ "CPO $", 3 }, // e4
+	{ "PUSH H", 1 }, // e5
+	{ "ANI $", 2 }, // e6
+	{ "RST 4", 1 }, // e7
+	{ "RPE", 1 }, // e8
+	{ "PCHL", 1 }, // e9
+	{ "JPE $", 3 }, // ea
+	{ "XCHG", 1 }, // eb
+	{ "CPE $", 3 }, // ec
+	{ "0xed ILLEGAL", 1 }, // ed
+	{ "XRI $", 2 }, // ee
+	{ "RST 5", 1 }, // ef
+	{ "RP", 1 }, // f0
+	{ "POP PSW", 1 }, // f1
+	{ "JP $", 3 }, // f2
+	{ "DI", 1 }, // f3
+	{ "CP $", 3 }, // f4
+	{ "PUSH PSW", 1 }, // f5
+	{ "ORI $", 2 }, // f6
+	{ "RST 6", 1 }, // f7
+	{ "RM", 1 }, // f8
+	{ "SPHL", 1 }, // f9
+	{ "JM $", 3 }, // fa
+	{ "EI", 1 }, // fb
+	{ "CM $", 3 }, // fc
+	{ "0xfd ILLEGAL", 1 }, // fd
+	{ "CPI $", 2 }, // fe
+	{ "RST 7", 1 }, // ff
+};
 
-		case 0x98: printf("SBB B"); break;
-		case 0x99: printf("SBB C"); break;
-		case 0x9a: printf("SBB D"); break;
-		case 0x9b: printf("SBB E"); break;
-		case 0x9c: printf("SBB H"); break;
-		case 0x9d: printf("SBB L"); break;
-		case 0x9e: printf("SBB M"); break;
-		case 0x9f: printf("SBB A"); break;
+static const char hex[] = "0123456789abcdef";
 
-		case 0xa0: printf("ANA B"); break;
-		case 0xa1: printf("ANA C"); break;
-		case 0xa2: printf("ANA D"); break;
-		case 0xa3: printf("ANA E"); break;
-		case 0xa4: printf("ANA H"); break;
-		case 0xa5: printf("ANA L"); break;
-		case 0xa6: printf("ANA M"); break;
-		case 0xa7: printf("ANA A"); break;
-
-		case 0xa8: printf("XRA B"); break;
-		case 0xa9: printf("XRA C"); break;
-		case 0xaa: printf("XRA D"); break;
-		case 0xab: printf("XRA E"); break;
-		case 0xac: printf("XRA H"); break;
-		case 0xad: printf("XRA L"); break;
-		case 0xae: printf("XRA M"); break;
-		case 0xaf: printf("XRA A"); break;
-
-		case 0xb0: printf("ORA B"); break;
-		case 0xb1: printf("ORA C"); break;
-		case 0xb2: printf("ORA D"); break;
-		case 0xb3: printf("ORA E"); break;
-		case 0xb4: printf("ORA H"); break;
-		case 0xb5: printf("ORA L"); break;
-		case 0xb6: printf("ORA M"); break;
-		case 0xb7: printf("ORA A"); break;
-
-		case 0xb8: printf("CMP B"); break;
-		case 0xb9: printf("CMP C"); break;
-		case 0xba: printf("CMP D"); break;
-		case 0xbb: printf("CMP E"); break;
-		case 0xbc: printf("CMP H"); break;
-		case 0xbd: printf("CMP L"); break;
-		case 0xbe: printf("CMP M"); break;
-		case 0xbf: printf("CMP A"); break;
+static char *
+put_hex(char *out, uint8_t byte) {
+	out[0] = hex[byte >> 4];
+	out[1] = hex[byte & 0xf];
+	return out + 2;
+}
 
-		case 0xc0: printf("RNZ"); break;
-		case 0xc1: printf("POP B"); break;
-		case 0xc2: printf("JNZ $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xc3: printf("JMP $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xc4: printf("CNZ $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xc5: printf("PUSH B"); break;
-		case 0xc6: printf("ADI $%02x", opcode[1]); bytes = 2; break;
-		case 0xc7: printf("RST 0"); break;
-		case 0xc8: printf("RZ"); break;
-		case 0xc9: printf("RET"); break;
-		case 0xca: printf("JZ $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xcb: printf("0xcb ILLEGAL"); break;
+/*
+ * formats the instruction at op into out, which needs DISASM_MAX bytes,
+ * and returns its length. 16 bit operands are printed in the order they
+ * are stored, low byte first.
+ */
+int
+disassemble(const uint8_t *op, char *out) {
+	const char *text = table[op[0]].text;
+	int bytes = table[op[0]].bytes;
+	size_t len = strlen(text);
 
-		case 0xcc: printf("CZ $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xcd: printf("CALL $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xce: printf("ACI $%02x", opcode[1]); bytes = 2; break;
-		case 0xcf: printf("RST 1"); break;
-		case 0xd0: printf("RNC"); break;
-		case 0xd1: printf("POP D"); break;
-		case 0xd2: printf("JNC $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xd3: printf("OUT $%02x", opcode[1]); bytes = 2; break;
-		case 0xd4: printf("CNC $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xd5: printf("PUSH D"); break;
-		case 0xd6: printf("SUI $%02x", opcode[1]); bytes = 2; break;
-		case 0xd7: printf("RST 2"); break;
-		case 0xd8: printf("RC"); break;
-		case 0xd9: printf("0xd9 ILLEGAL"); break;
+	memcpy(out, text, len);
+	out += len;
+	for (int i = 1; i < bytes; i++)
+		out = put_hex(out, op[i]);
+	*out = '\0';
+	return bytes;
+}
 
-		case 0xda: printf("JC $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xdb: printf("IN $%02x", opcode[1]); bytes = 2; break;
-		case 0xdc: printf("CC $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xdd: printf("0xdd ILLEGAL"); break;
+int
+disassemble_length(uint8_t op) {
+	return table[op].bytes;
+}
 
-		case 0xde: printf("SBI $%02x", opcode[1]); bytes = 2; break;
-		case 0xdf: printf("RST 3"); break;
-		case 0xe0: printf("RPO"); break;
-		case 0xe1: printf("POP H"); break;
-		case 0xe2: printf("JPO $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xe3: printf("XTHL"); break;
-		case 0xe4: printf("CPO $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xe5: printf("PUSH H"); break;
-		case 0xe6: printf("ANI $%02x", opcode[1]); bytes = 2; break;
-		case 0xe7: printf("RST 4"); break;
-		case 0xe8: printf("RPE"); break;
-		case 0xe9: printf("PCHL"); break;
-		case 0xea: printf("JPE $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xeb: printf("XCHG"); break;
-		case 0xec: printf("CPE $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xed: printf("0xed ILLEGAL"); break;
+// "pppp text", the line get_opname() prints
+int
+disassemble_line(const uint8_t *op, uint16_t pc, char *out) {
+	out = put_hex(out, pc >> 8);
+	out = put_hex(out, pc & 0xff);
+	*out++ = ' ';
+	return disassemble(op, out);
+}
 
-		case 0xee: printf("XRI $%02x", opcode[1]); bytes = 2; break;
-		case 0xef: printf("RST 5"); break;
-		case 0xf0: printf("RP"); break;
-		case 0xf1: printf("POP PSW"); break;
-		case 0xf2: printf("JP $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xf3: printf("DI"); break;
-		case 0xf4: printf("CP $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xf5: printf("PUSH PSW"); break;
-		case 0xf6: printf("ORI $%02x", opcode[1]); bytes = 2; break;
-		case 0xf7: printf("RST 6"); break;
-		case 0xf8: printf("RM"); break;
-		case 0xf9: printf("SPHL"); break;
-		case 0xfa: printf("JM $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xfb: printf("EI"); break;
-		case 0xfc: printf("CM $%02x%02x", opcode[1], opcode[2]); bytes = 3; break;
-		case 0xfd: printf("0xfd ILLEGAL"); break;
+/*
+ * one line per instruction from start up to end into out, stopping early
+ * when the next line would not fit in size. returns the characters
+ * written, out is always terminated.
+ */
+size_t
+disassemble_range(const uint8_t *code, uint16_t start, uint16_t end, char *out, size_t size) {
+	char line[DISASM_MAX];
+	size_t len = 0;
 
-		case 0xfe: printf("CPI $%02x", opcode[1]); bytes = 2; break;
-		case 0xff: printf("RST 7"); break;
+	if (size == 0)
+		return 0;
+	for (uint32_t pc = start; pc < end;) {
+		int bytes = disassemble_line(&code[pc], pc, line);
+		size_t n = strlen(line);
+		if (len + n + 2 > size)
+			break;
+		memcpy(&out[len], line, n);
+		len += n;
+		out[len++] = '\n';
+		pc += bytes;
 	}
+	out[len] = '\0';
+	return len;
+}
 
-	printf("\n");
+int
+get_opname(unsigned char *buf, int pc)
+{
+	char line[DISASM_MAX];
+	int bytes = disassemble_line(&buf[pc], pc, line);
+	puts(line);
 	return bytes;
 }
@@ -0,0 +1,1124 @@
+/*
+ * the body of emulate(), included by cpu.c once per variant. define
+ * EMULATE as the function name and any of EMULATE_TRACE, EMULATE_PROFILE,
+ * EMULATE_DEBUG, EMULATE_COVERAGE and EMULATE_DIRTY for the instrumentation
+ * that variant carries; the plain variant defines none and pays for none.
+ */
+
+#ifdef EMULATE_DIRTY
+#define STORE store_dirty
+#define PUSH push_dirty
+#define CALL call_dirty
+#else
+#define STORE store
+#define PUSH push
+#define CALL call
+#endif
+
+int
+EMULATE(struct CPU *cpu) {
+#ifdef EMULATE_DEBUG
+	// the hook returns when the instruction may run, which it then does
+	if (debug_flags[cpu->pc] && debug_hook)
+		debug_hook(cpu);
+#endif
+	uint8_t *opcode = &cpu->ram[cpu->pc];
+#ifdef EMULATE_PROFILE
+	profile.pc_count[cpu->pc]++;
+#endif
+#ifdef EMULATE_COVERAGE
+	coverage[cpu->pc >> 3] |= 1 << (cpu->pc & 7);
+#endif
+#ifdef EMULATE_TRACE
+	uint16_t pc = cpu->pc;
+#endif
+	cpu->pc++;
+	switch (*opcode) {
+		case 0x00: // NOP
+			break;
+		case 0x01: // LXI  B,d16
+			cpu->c = opcode[1];
+			cpu->b = opcode[2];
+			cpu->pc += 2;
+			break;
+		case 0x02: // STAX B
+		{
+			uint16_t adr = cpu->b << 8 | cpu->c;
+			STORE(cpu, adr, cpu->a);
+			break;
+		}
+		case 0x03: // INX  B
+			cpu->c++;
+			if (cpu->c == 0)
+				cpu->b++;
+			break;
+		case 0x04: // INR  B
+			cpu->b = inr(cpu, cpu->b);
+			break;
+		case 0x05: // DCR  B
+			cpu->b = dcr(cpu, cpu->b);
+			break;
+		case 0x06: // MVI  B,d8
+			cpu->b = opcode[1];
+			cpu->pc++;
+			break;
+		case 0x07: // RLC
+		{
+			uint8_t x = cpu->a;
+			cpu->a = (x << 1) | ((x & (1 << 7)) >> 7);
+			cpu->flags.c = x >> 7;
+			break;
+		}
+		case 0x08: // 0x08 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0x09: // DAD  B
+		{
+			uint16_t hl = (cpu->h << 8) | cpu->l;
+			uint16_t add = (cpu->b << 8) | cpu->c;
+
+			uint32_t res = hl + add;
+			cpu->h = res >> 8;
+			cpu->l = res & 0xff;
+			cpu->flags.c = (res >> 16) & 1;
+			break;
+		}
+		case 0x0a: // LDAX B
+		{
+			uint16_t adr = (cpu->b << 8) | cpu->c;
+			cpu->a = cpu->ram[adr];
+			break;
+		}
+		case 0x0b: // DCX  B
+		{
+			uint16_t bc = cpu->b << 8 | cpu->c;
+			bc--;
+			cpu->b = bc >> 8;
+			cpu->c = bc & 0xff;
+			break;
+		}
+		case 0x0c: // INR  C
+			cpu->c = inr(cpu, cpu->c);
+			break;
+		case 0x0d: // DCR  C
+			cpu->c = dcr(cpu, cpu->c);
+			break;
+		case 0x0e: // MVI  C,d8
+			cpu->c = opcode[1];
+			cpu->pc++;
+			break;
+		case 0x0f: // RRC
+		{
+			uint8_t x = cpu->a;
+			cpu->a = ((x & 1) << 7) | (x >> 1);
+			cpu->flags.c = ((x & 1) == 1);
+			break;
+		}
+		case 0x10: // 0x10 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0x11: // LXI  D,d16
+			cpu->e = opcode[1];
+			cpu->d = opcode[2];
+			cpu->pc += 2;
+			break;
+		case 0x12: // STAX D
+		{
+			uint16_t adr = cpu->d << 8 | cpu->e;
+			STORE(cpu, adr, cpu->a);
+			break;
+		}
+		case 0x13: // INX  D
+		{
+            uint16_t de = (cpu->d << 8) | cpu->e;
+            de++;
+            cpu->d = de >> 8;
+            cpu->e = de & 0xff;
+			break;
+		}
+		case 0x14: // INR  D
+			cpu->d = inr(cpu, cpu->d);
+			break;
+		case 0x15: // DCR  D
+			cpu->d = dcr(cpu, cpu->d);
+			break;
+		case 0x16: // MVI  D,d8
+			cpu->d = opcode[1];
+			cpu->pc++;
+			break;
+		case 0x17: // RAL
+		{
+			uint8_t x = cpu->a;
+			cpu->a <<= 1;
+			cpu->a |= cpu->flags.c;
+			cpu->flags.c = x >> 7;
+			break;
+		}
+		case 0x18: // 0x18 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0x19: // DAD  D
+		{
+			uint16_t hl = (cpu->h << 8) | cpu->l;
+			uint16_t add = (cpu->d << 8) | cpu->e;
+
+			uint32_t res = hl + add;
+			cpu->h = res >> 8;
+			cpu->l = res & 0xff;
+			cpu->flags.c = (res >> 16) & 1;
+			break;
+		}
+		case 0x1a: // LDAX D
+		{
+			uint16_t adr = (cpu->d << 8) | cpu->e;
+			cpu->a = cpu->ram[adr];
+			break;
+		}
+		case 0x1b: // DCX  D
+		{
+			uint16_t de = cpu->d << 8 | cpu->e;
+			de--;
+			cpu->d = de >> 8;
+			cpu->e = de & 0xff;
+			break;
+		}
+		case 0x1c: // INR  E
+			cpu->e = inr(cpu, cpu->e);
+			break;
+		case 0x1d: // DCR  E
+			cpu->e = dcr(cpu, cpu->e);
+			break;
+		case 0x1e: // MVI  E,d8
+			cpu->e = opcode[1];
+			cpu->pc++;
+			break;
+		case 0x1f: // RAR
+		{
+			uint8_t x = cpu->a;
+			cpu->a = (cpu->flags.c << 7) | (x >> 1);
+			cpu->flags.c = (1 == (x & 1));
+			break;
+		}
+		case 0x20: // 0x20 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0x21: // LXI  H,d16
+			cpu->l = opcode[1];
+			cpu->h = opcode[2];
+            cpu->pc += 2;
+			break;
+		case 0x22: // SHLD a16
+		{
+			uint16_t adr = opcode[2] << 8 | opcode[1];
+			STORE(cpu, adr + 1, cpu->h);
+			STORE(cpu, adr, cpu->l);
+			cpu->pc += 2;
+			break;
+		}
+		case 0x23: // INX  H
+		{
+			uint16_t hl = (cpu->h << 8) | cpu->l;
+			hl++;
+			cpu->h = hl >> 8;
+			cpu->l = hl & 0xff;
+			break;
+		}
+		case 0x24: // INR  H
+			cpu->h = inr(cpu, cpu->h);
+			break;
+		case 0x25: // DCR  H
+			cpu->h = dcr(cpu, cpu->h);
+			break;
+		case 0x26: // MVI  H,d8
+			cpu->h = opcode[1];
+			cpu->pc++;
+			break;
+		case 0x27: // DAA
+			daa(cpu);
+			break;
+		case 0x28: // 0x28 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0x29: // DAD  H
+		{
+			uint16_t hl = (cpu->h << 8) | cpu->l;
+			uint16_t add = (cpu->h << 8) | cpu->l;
+
+			uint32_t res = hl + add;
+			cpu->h = res >> 8;
+			cpu->l = res & 0xff;
+
+			cpu->flags.c = (res >> 16) & 1;
+			break;
+		}
+		case 0x2a: // LHLD a16
+		{
+			uint16_t adr = opcode[2] << 8 | opcode[1];
+			cpu->h = cpu->ram[adr + 1];
+			cpu->l = cpu->ram[adr];
+			cpu->pc += 2;
+			break;
+		}
+		case 0x2b: // DCX  H
+		{
+			uint16_t hl = cpu->h << 8 | cpu->l;
+			hl--;
+			cpu->h = hl >> 8;
+			cpu->l = hl & 0xff;
+		}
+			break;
+		case 0x2c: // INR  L
+			cpu->l = inr(cpu, cpu->l);
+			break;
+		case 0x2d: // DCR  L
+			cpu->l = dcr(cpu, cpu->l);
+			break;
+		case 0x2e: // MVI  L,d8
+			cpu->l = opcode[1];
+			cpu->pc++;
+			break;
+		case 0x2f: // CMA
+			cpu->a = ~cpu->a;
+			break;
+		case 0x30: // 0x30 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0x31: // LXI  SP d16
+			cpu->sp = (opcode[2] << 8) | opcode[1];
+			cpu->pc += 2;
+			break;
+		case 0x32: // STA a16
+		{
+			uint16_t adr = (opcode[2] << 8) | opcode[1];
+			STORE(cpu, adr, cpu->a);
+			cpu->pc += 2;
+			break;
+		}
+		case 0x33: // INX  SP
+			cpu->sp++;
+			break;
+		case 0x34: // INR  M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, inr(cpu, cpu->ram[adr]));
+			break;
+		}
+		case 0x35: // DCR  M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, dcr(cpu, cpu->ram[adr]));
+			break;
+		}
+		case 0x36: // MVI  M,d8
+		{
+			uint16_t adr = (cpu->h << 8) | cpu->l;
+			STORE(cpu, adr, opcode[1]);
+			cpu->pc++;
+			break;
+		}
+		case 0x37: // STC
+			cpu->flags.c = 1;
+			break;
+		case 0x38: // 0x38 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0x39: // DAD  SP
+		{
+			uint16_t hl = (cpu->h << 8) | cpu->l;
+
+			uint32_t res = hl + cpu->sp;
+			cpu->h = res >> 8;
+			cpu->l = res & 0xff;
+			cpu->flags.c = (res >> 16) & 1;
+			break;
+		}
+		case 0x3a: // LDA a16
+		{
+			uint16_t adr = (opcode[2] << 8) | opcode[1];
+			cpu->a = cpu->ram[adr];
+			cpu->pc += 2;
+			break;
+		}
+		case 0x3b: // DCX  SP
+			cpu->sp--;
+			break;
+		case 0x3c: // INR  A
+			cpu->a = inr(cpu, cpu->a);
+			break;
+		case 0x3d: // DCR  A
+			cpu->a = dcr(cpu, cpu->a);
+			break;
+		case 0x3e: // MVI  A,d8
+			cpu->a = opcode[1];
+			cpu->pc++;
+			break;
+		case 0x3f: // CMC
+			cpu->flags.c = ~cpu->flags.c;
+			break;
+		case 0x40: // MOV B,B
+			cpu->b = cpu->b;
+			break;
+		case 0x41: // MOV B,C
+			cpu->b = cpu->c;
+			break;
+		case 0x42: // MOV B,D
+			cpu->b = cpu->d;
+			break;
+		case 0x43: // MOV B,E
+			cpu->b = cpu->e;
+			break;
+		case 0x44: // MOV B,H
+			cpu->b = cpu->h;
+			break;
+		case 0x45: // MOV B,L
+			cpu->b = cpu->l;
+			break;
+		case 0x46: // MOV B,M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			cpu->b = cpu->ram[adr];
+			break;
+		}
+		case 0x47: // MOV B,A
+			cpu->b = cpu->a;
+			break;
+		case 0x48: // MOV C,B
+			cpu->c = cpu->b;
+			break;
+		case 0x49: // MOV C,C
+			cpu->c = cpu->c;
+			break;
+		case 0x4a: // MOV C,D
+			cpu->c = cpu->d;
+			break;
+		case 0x4b: // MOV C,E
+			cpu->c = cpu->e;
+			break;
+		case 0x4c: // MOV C,H
+			cpu->c = cpu->h;
+			break;
+		case 0x4d: // MOV C,L
+			cpu->c = cpu->l;
+			break;
+		case 0x4e: // MOV C,M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			cpu->c = cpu->ram[adr];
+			break;
+		}
+		case 0x4f: // MOV C,A
+			cpu->c = cpu->a;
+			break;
+		case 0x50: // MOV D,B
+			cpu->d = cpu->b;
+			break;
+		case 0x51: // MOV D,C
+			cpu->d = cpu->c;
+			break;
+		case 0x52: // MOV D,D
+			cpu->d = cpu->d;
+			break;
+		case 0x53: // MOV D,E
+			cpu->d = cpu->e;
+			break;
+		case 0x54: // MOV D,H
+			cpu->d = cpu->h;
+			break;
+		case 0x55: // MOV D,L
+			cpu->d = cpu->l;
+			break;
+		case 0x56: // MOV D,M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			cpu->d = cpu->ram[adr];
+			break;
+		}
+		case 0x57: // MOV D,A
+			cpu->d = cpu->a;
+			break;
+		case 0x58: // MOV E,B
+			cpu->e = cpu->b;
+			break;
+		case 0x59: // MOV E,C
+			cpu->e = cpu->c;
+			break;
+		case 0x5a: // MOV E,D
+			cpu->e = cpu->d;
+			break;
+		case 0x5b: // MOV E,E
+			cpu->e = cpu->e;
+			break;
+		case 0x5c: // MOV E,H
+			cpu->e = cpu->h;
+			break;
+		case 0x5d: // MOV E,L
+			cpu->e = cpu->l;
+			break;
+		case 0x5e: // MOV E,M
+		{
+			uint16_t adr = (cpu->h << 8) | cpu->l;
+			cpu->e = cpu->ram[adr];
+			break;
+		}
+		case 0x5f: // MOV E,A
+			cpu->e = cpu->a;
+			break;
+		case 0x60: // MOV H,B
+			cpu->h = cpu->b;
+			break;
+		case 0x61: // MOV H,C
+			cpu->h = cpu->c;
+			break;
+		case 0x62: // MOV H,D
+			cpu->h = cpu->d;
+			break;
+		case 0x63: // MOV H,E
+			cpu->h = cpu->e;
+			break;
+		case 0x64: // MOV H,H
+			cpu->h = cpu->h;
+			break;
+		case 0x65: // MOV H,L
+			cpu->h = cpu->l;
+			break;
+		case 0x66: // MOV H,M
+		{
+			uint16_t adr = (cpu->h << 8) | cpu->l;
+			cpu->h = cpu->ram[adr];
+			break;
+		}
+		case 0x67: // MOV H,A
+			cpu->h = cpu->a;
+			break;
+		case 0x68: // MOV L,B
+			cpu->l = cpu->b;
+			break;
+		case 0x69: // MOV L,C
+			cpu->l = cpu->c;
+			break;
+		case 0x6a: // MOV L,D
+			cpu->l = cpu->d;
+			break;
+		case 0x6b: // MOV L,E
+			cpu->l = cpu->e;
+			break;
+		case 0x6c: // MOV L,H
+			cpu->l = cpu->h;
+			break;
+		case 0x6d: // MOV L,L
+			cpu->l = cpu->l;
+			break;
+		case 0x6e: // MOV L,M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			cpu->l = cpu->ram[adr];
+			break;
+		}
+		case 0x6f: // MOV L,A
+			cpu->l = cpu->a;
+			break;
+		case 0x70: // MOV M,B
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, cpu->b);
+			break;
+		}
+		case 0x71: // MOV M,C
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, cpu->c);
+			break;
+		}
+		case 0x72: // MOV M,D
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, cpu->d);
+			break;
+		}
+		case 0x73: // MOV M,E
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, cpu->e);
+			break;
+		}
+		case 0x74: // MOV M,H
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, cpu->h);
+			break;
+		}
+		case 0x75: // MOV M,L
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			STORE(cpu, adr, cpu->l);
+			break;
+		}
+		case 0x76: // HLT
+			exit(1);
+			break;
+		case 0x77: // MOV M,A
+		{
+			uint16_t adr = (cpu->h << 8) | cpu->l;
+			STORE(cpu, adr, cpu->a);
+			break;
+		}
+		case 0x78: // MOV A,B
+			cpu->a = cpu->b;
+			break;
+		case 0x79: // MOV A,C
+			cpu->a = cpu->c;
+			break;
+		case 0x7a: // MOV A,D
+			cpu->a = cpu->d;
+			break;
+		case 0x7b: // MOV A,E
+			cpu->a = cpu->e;
+			break;
+		case 0x7c: // MOV A,H
+			cpu->a = cpu->h;
+			break;
+		case 0x7d: // MOV A,L
+			cpu->a = cpu->l;
+			break;
+		case 0x7e: // MOV A,M
+		{
+			uint16_t adr = (cpu->h << 8) | cpu->l;
+			cpu->a = cpu->ram[adr];
+			break;
+		}
+		case 0x7f: // MOV A,A
+			unimplemented(opcode[0]);
+			cpu->a = cpu->h;
+			break;
+		case 0x80: // ADD B
+			add(cpu, cpu->b, 0);
+			break;
+		case 0x81: // ADD C
+			add(cpu, cpu->c, 0);
+			break;
+		case 0x82: // ADD D
+			add(cpu, cpu->d, 0);
+			break;
+		case 0x83: // ADD E
+			add(cpu, cpu->e, 0);
+			break;
+		case 0x84: // ADD H
+			add(cpu, cpu->h, 0);
+			break;
+		case 0x85: // ADD L
+			add(cpu, cpu->l, 0);
+			break;
+		case 0x86: // ADD M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			add(cpu, cpu->ram[adr], 0);
+			break;
+		}
+		case 0x87: // ADD A
+			add(cpu, cpu->a, 0);
+			break;
+		case 0x88: // ADC B
+			add(cpu, cpu->b, cpu->flags.c);
+			break;
+		case 0x89: // ADC C
+			add(cpu, cpu->c, cpu->flags.c);
+			break;
+		case 0x8a: // ADC D
+			add(cpu, cpu->d, cpu->flags.c);
+			break;
+		case 0x8b: // ADC E
+			add(cpu, cpu->e, cpu->flags.c);
+			break;
+		case 0x8c: // ADC H
+			add(cpu, cpu->h, cpu->flags.c);
+			break;
+		case 0x8d: // ADC L
+			add(cpu, cpu->l, cpu->flags.c);
+			break;
+		case 0x8e: // ADC M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			add(cpu, cpu->ram[adr], cpu->flags.c);
+			break;
+		}
+		case 0x8f: // ADC A
+			add(cpu, cpu->a, cpu->flags.c);
+			break;
+		case 0x90: // SUB B
+			cpu->a = sub(cpu, cpu->b, 0);
+			break;
+		case 0x91: // SUB C
+			cpu->a = sub(cpu, cpu->c, 0);
+			break;
+		case 0x92: // SUB D
+			cpu->a = sub(cpu, cpu->d, 0);
+			break;
+		case 0x93: // SUB E
+			cpu->a = sub(cpu, cpu->e, 0);
+			break;
+		case 0x94: // SUB H
+			cpu->a = sub(cpu, cpu->h, 0);
+			break;
+		case 0x95: // SUB L
+			cpu->a = sub(cpu, cpu->l, 0);
+			break;
+		case 0x96: // SUB M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			cpu->a = sub(cpu, cpu->ram[adr], 0);
+			break;
+		}
+		case 0x97: // SUB A
+			cpu->a = sub(cpu, cpu->a, 0);
+			break;
+		case 0x98: // SBB B
+			cpu->a = sub(cpu, cpu->b, cpu->flags.c);
+			break;
+		case 0x99: // SBB C
+			cpu->a = sub(cpu, cpu->c, cpu->flags.c);
+			break;
+		case 0x9a: // SBB D
+			cpu->a = sub(cpu, cpu->d, cpu->flags.c);
+			break;
+		case 0x9b: // SBB E
+			cpu->a = sub(cpu, cpu->e, cpu->flags.c);
+			break;
+		case 0x9c: // SBB H
+			cpu->a = sub(cpu, cpu->h, cpu->flags.c);
+			break;
+		case 0x9d: // SBB L
+			cpu->a = sub(cpu, cpu->l, cpu->flags.c);
+			break;
+		case 0x9e: // SBB M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			cpu->a = sub(cpu, cpu->ram[adr], cpu->flags.c);
+			break;
+		}
+		case 0x9f: // SBB A
+			cpu->a = sub(cpu, cpu->a, cpu->flags.c);
+			break;
+		case 0xa0: // ANA B
+			ana(cpu, cpu->b);
+			break;
+		case 0xa1: // ANA C
+			ana(cpu, cpu->c);
+			break;
+		case 0xa2: // ANA D
+			ana(cpu, cpu->d);
+			break;
+		case 0xa3: // ANA E
+			ana(cpu, cpu->e);
+			break;
+		case 0xa4: // ANA H
+			ana(cpu, cpu->h);
+			break;
+		case 0xa5: // ANA L
+			ana(cpu, cpu->l);
+			break;
+		case 0xa6: // ANA M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			ana(cpu, cpu->ram[adr]);
+			break;
+		}
+		case 0xa7: // ANA A
+			ana(cpu, cpu->a);
+			break;
+		case 0xa8: // XRA B
+			xra(cpu, cpu->b);
+			break;
+		case 0xa9: // XRA C
+			xra(cpu, cpu->c);
+			break;
+		case 0xaa: // XRA D
+			xra(cpu, cpu->d);
+			break;
+		case 0xab: // XRA E
+			xra(cpu, cpu->e);
+			break;
+		case 0xac: // XRA H
+			xra(cpu, cpu->h);
+			break;
+		case 0xad: // XRA L
+			xra(cpu, cpu->l);
+			break;
+		case 0xae: // XRA M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			xra(cpu, cpu->ram[adr]);
+			break;
+		}
+		case 0xaf: // XRA A
+			xra(cpu, cpu->a);
+			break;
+		case 0xb0: // ORA B
+			ora(cpu, cpu->b);
+			break;
+		case 0xb1: // ORA C
+			ora(cpu, cpu->c);
+			break;
+		case 0xb2: // ORA D
+			ora(cpu, cpu->d);
+			break;
+		case 0xb3: // ORA E
+			ora(cpu, cpu->e);
+			break;
+		case 0xb4: // ORA H
+			ora(cpu, cpu->h);
+			break;
+		case 0xb5: // ORA L
+			ora(cpu, cpu->l);
+			break;
+		case 0xb6: // ORA M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			ora(cpu, cpu->ram[adr]);
+			break;
+		}
+		case 0xb7: // ORA A
+			ora(cpu, cpu->a);
+			break;
+		case 0xb8: // CMP B
+			sub(cpu, cpu->b, 0);
+			break;
+		case 0xb9: // CMP C
+			sub(cpu, cpu->c, 0);
+			break;
+		case 0xba: // CMP D
+			sub(cpu, cpu->d, 0);
+			break;
+		case 0xbb: // CMP E
+			sub(cpu, cpu->e, 0);
+			break;
+		case 0xbc: // CMP H
+			sub(cpu, cpu->h, 0);
+			break;
+		case 0xbd: // CMP L
+			sub(cpu, cpu->l, 0);
+			break;
+		case 0xbe: // CMP M
+		{
+			uint16_t adr = cpu->h << 8 | cpu->l;
+			sub(cpu, cpu->ram[adr], 0);
+			break;
+		}
+		case 0xbf: // CMP A
+			sub(cpu, cpu->a, 0);
+			break;
+		case 0xc0: // RNZ
+			if (cpu->flags.z == 0)
+				ret(cpu);
+			break;
+		case 0xc1: // POP B
+		{
+			uint16_t val = pop(cpu);
+			cpu->b = val >> 8;
+			cpu->c = val & 0xff;
+
+			break;
+		}
+		case 0xc2: // JNZ a16
+			if (cpu->flags.z == 0)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xc3: // JMP a16
+			cpu->pc = (opcode[2] << 8) | opcode[1];
+			break;
+		case 0xc4: // CNZ a16
+			if (cpu->flags.z == 0)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xc5: // PUSH B
+			PUSH(cpu, cpu->b, cpu->c);
+			break;
+		case 0xc6: // ADI d8
+			add(cpu, opcode[1], 0);
+			cpu->pc++;
+			break;
+		case 0xc7: // RST 0
+			unimplemented(opcode[0]);
+			break;
+		case 0xc8: // RZ
+			if (cpu->flags.z)
+				ret(cpu);
+			break;
+		case 0xc9: // RET
+			ret(cpu);
+			break;
+		case 0xca: // JZ a16
+			if (cpu->flags.z)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xcb: // 0xcb ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0xcc: // CZ a16
+			if (cpu->flags.z)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xcd: // CALL a16
+		{
+			CALL(cpu, opcode);
+			break;
+		}
+		case 0xce: // ACI d8
+			add(cpu, opcode[1], cpu->flags.c);
+			cpu->pc++;
+			break;
+		case 0xcf: // RST 1
+			unimplemented(opcode[0]);
+			break;
+		case 0xd0: // RNC
+			if (cpu->flags.c == 0)
+				ret(cpu);
+			break;
+		case 0xd1: // POP D
+		{
+			uint16_t val = pop(cpu);
+			cpu->d = val >> 8;
+			cpu->e = val & 0xff;
+			break;
+		}
+		case 0xd2: // JNC a16
+			if (cpu->flags.c != 1)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xd3: // OUT d8
+			out(cpu, opcode[1]);
+			cpu->pc++;
+			break;
+		case 0xd4: // CNC a16
+			if (cpu->flags.c == 0)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xd5: // PUSH D
+			PUSH(cpu, cpu->d, cpu->e);
+			break;
+		case 0xd6: // SUI d8
+			cpu->a = sub(cpu, opcode[1], 0);
+			cpu->pc++;
+			break;
+		case 0xd7: // RST 2
+			unimplemented(opcode[0]);
+			break;
+		case 0xd8: // RC
+			if (cpu->flags.c)
+				ret(cpu);
+			break;
+		case 0xd9: // 0xd9 ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0xda: // JC a16
+			if (cpu->flags.c)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xdb: // IN d8
+			cpu->a = in(cpu, opcode[1]);
+			cpu->pc++;
+			break;
+		case 0xdc: // CC a16
+			if (cpu->flags.c)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xdd: // 0xdd ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0xde: // SBI d8
+			cpu->a = sub(cpu, opcode[1], cpu->flags.c);
+			cpu->pc++;
+			break;
+		case 0xdf: // RST 3
+			unimplemented(opcode[0]);
+			break;
+		case 0xe0: // RPO
+			if (cpu->flags.p == 0)
+				ret(cpu);
+			break;
+		case 0xe1: // POP H
+		{
+			uint16_t val = pop(cpu);
+			cpu->h = val >> 8;
+			cpu->l = val & 0xff;
+			break;
+		}
+		case 0xe2: // JPO a16
+			if (cpu->flags.p == 0)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xe3: // XTHL
+		{
+			uint16_t val = pop(cpu);
+			uint16_t hl = cpu->h << 8 | cpu->l;
+			cpu->h = val >> 8;
+			cpu->l = val & 0xff;
+			PUSH(cpu, hl >> 8, hl & 0xff);
+			break;
+		}
+		case 0xe4: // CPO a16
+			if (cpu->flags.p == 0)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xe5: // PUSH H
+			PUSH(cpu, cpu->h, cpu->l);
+			break;
+		case 0xe6: // ANI d8
+			ana(cpu, opcode[1]);
+			cpu->pc++;
+			break;
+		case 0xe7: // RST 4
+			unimplemented(opcode[0]);
+			break;
+		case 0xe8: // RPE
+			if (cpu->flags.p)
+				ret(cpu);
+			break;
+		case 0xe9: // PCHL
+			cpu->pc = cpu->h << 8 | cpu->l;
+			break;
+		case 0xea: // JPE a16
+			if (cpu->flags.p == 1)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xeb: // XCHG
+		{
+			uint8_t d = cpu->d;
+			uint8_t e = cpu->e;
+
+			cpu->d = cpu->h;
+			cpu->e = cpu->l;
+
+			cpu->h = d;
+			cpu->l = e;
+			break;
+		}
+		case 0xec: // CPE a16
+			if (cpu->flags.p)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xed: // 0xed ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0xee: // XRI d8
+			xra(cpu, opcode[1]);
+			cpu->pc++;
+			break;
+		case 0xef: // RST 5
+			unimplemented(opcode[0]);
+			break;
+		case 0xf0: // RP
+			if (cpu->flags.s == 0)
+				ret(cpu);
+			break;
+		case 0xf1: // POP PSW
+		{
+			uint16_t af = pop(cpu);
+			cpu->a = af >> 8;
+			set_psw(&cpu->flags, af & 0xff);
+			break;
+		}
+		case 0xf2: // JP a16
+			if (cpu->flags.s == 0)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xf3: // DI
+			cpu->interrupts = 0;
+			break;
+		case 0xf4: // CP a16
+			if (cpu->flags.s == 0)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xf5: // PUSH PSW
+		{
+			uint8_t psw = get_psw(&cpu->flags);
+			PUSH(cpu, cpu->a, psw);
+			break;
+		}
+		case 0xf6: // ORI d8
+			ora(cpu, opcode[1]);
+			cpu->pc++;
+			break;
+		case 0xf7: // RST 6
+			unimplemented(opcode[0]);
+			break;
+		case 0xf8: // RM
+			if (cpu->flags.s)
+				ret(cpu);
+			break;
+		case 0xf9: // SPHL
+		{
+			uint16_t hl = cpu->h << 8 | cpu->l;
+			cpu->sp = hl;
+			break;
+		}
+		case 0xfa: // JM a16
+			if (cpu->flags.s == 1)
+				cpu->pc = (opcode[2] << 8) | opcode[1];
+			else
+				cpu->pc += 2;
+			break;
+		case 0xfb: // EI
+			cpu->interrupts = 1;
+			break;
+		case 0xfc: // CM a16
+			if (cpu->flags.s == 1)
+				CALL(cpu, opcode);
+			else
+				cpu->pc += 2;
+			break;
+		case 0xfd: // 0xfd ILLEGAL
+			unimplemented(opcode[0]);
+			break;
+		case 0xfe: // CPI d8
+			sub(cpu, opcode[1], 0);
+			cpu->pc++;
+			break;
+		case 0xff: // RST 7
+			unimplemented(opcode[0]);
+			break;
+	}
+
+#ifdef EMULATE_TRACE
+	if (trace_hook)
+		trace_hook(cpu, pc, cycles8080[*opcode]);
+#endif
+	return cycles8080[*opcode];
+}
+
+#undef EMULATE
+#undef EMULATE_TRACE
+#undef EMULATE_PROFILE
+#undef EMULATE_DEBUG
+#undef EMULATE_COVERAGE
+#undef EMULATE_DIRTY
+#undef STORE
+#undef PUSH
+#undef CALL
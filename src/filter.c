@@ -0,0 +1,317 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WEB
+#include <pthread.h>
+#endif
+
+#include "filter.h"
+
+#define W FILTER_WIDTH
+#define H FILTER_HEIGHT
+
+enum GEL {
+	GEL_NONE,
+	GEL_RED,
+	GEL_GREEN,
+};
+
+static const uint32_t gels[] = {
+	[GEL_NONE] = 0xffffff,
+	[GEL_RED] = 0xff2020,
+	[GEL_GREEN] = 0x20ff20,
+};
+
+// the strips of coloured film on the cabinet's glass, in upright screen rows
+static enum GEL
+gel(int x, int y) {
+	if (y >= 32 && y < 64)
+		return GEL_RED; // saucer
+	if (y >= 184 && y < 240)
+		return GEL_GREEN; // shields and the player
+	if (y >= 240 && x >= 16 && x < 134)
+		return GEL_GREEN; // the reserve ships
+	return GEL_NONE;
+}
+
+// an 8x8 bit matrix, bit c of byte r, transposed
+static uint64_t
+transpose(uint64_t x) {
+	uint64_t t;
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaull;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccull;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ull;
+	x ^= t ^ (t << 28);
+	return x;
+}
+
+/*
+ * rows y0 to y1 of video ram, which holds the screen turned 90 degrees,
+ * to 0 or 255. eight columns of a byte each turn into eight rows of
+ * eight pixels, then a byte at a time through the bytes table.
+ */
+static void
+expand(struct Filter *f, int y0, int y1) {
+	for (int i = (H - y1) / 8; i <= (H - 1 - y0) / 8; i++) {
+		for (int x = 0; x < W; x += 8) {
+			uint64_t m = 0;
+			for (int j = 0; j < 8; j++)
+				m |= (uint64_t)f->vram[(x + j) * (H / 8) + i] << (8 * j);
+			m = transpose(m);
+			for (int p = 0; p < 8; p++) {
+				int y = H - 1 - i * 8 - p;
+				if (y >= y0 && y < y1)
+					memcpy(&f->lum[y][x], &f->bytes[m >> (8 * p) & 0xff], 8);
+			}
+		}
+	}
+}
+
+// a lit pixel glows fully, an unlit one fades by persistence/256 a frame
+static void
+persist(struct Filter *f, int y0, int y1) {
+	uint16_t keep = f->config.persistence;
+	if (keep == 0) {
+		memcpy(f->glow[y0], f->lum[y0], (y1 - y0) * W);
+		return;
+	}
+	const uint8_t *restrict lum = f->lum[y0];
+	uint8_t *restrict glow = f->glow[y0];
+	for (int i = 0; i < (y1 - y0) * W; i++) {
+		uint8_t faded = (uint16_t)(glow[i] * keep) >> 8;
+		glow[i] = lum[i] | faded; // lum is 0 or 255
+	}
+}
+
+// scale2x of glow rows y0 to y1, each read with the rows around it padded at the edges
+static void
+scale2x(struct Filter *f, int y0, int y1) {
+	uint8_t b[W + 2], e[W + 2], h[W + 2];
+
+	for (int y = y0; y < y1; y++) {
+		memcpy(&b[1], f->glow[y > 0 ? y - 1 : y], W);
+		memcpy(&e[1], f->glow[y], W);
+		memcpy(&h[1], f->glow[y < H - 1 ? y + 1 : y], W);
+		b[0] = b[1], b[W + 1] = b[W];
+		e[0] = e[1], e[W + 1] = e[W];
+		h[0] = h[1], h[W + 1] = h[W];
+
+		uint8_t *top = f->smooth[y * 2];
+		uint8_t *bottom = f->smooth[y * 2 + 1];
+		for (int x = 0; x < W; x++) {
+			uint8_t B = b[x + 1], D = e[x], E = e[x + 1], F = e[x + 2], Hh = h[x + 1];
+			int edge = B != Hh && D != F;
+			top[x * 2] = edge && D == B ? D : E;
+			top[x * 2 + 1] = edge && B == F ? F : E;
+			bottom[x * 2] = edge && D == Hh ? D : E;
+			bottom[x * 2 + 1] = edge && Hh == F ? F : E;
+		}
+	}
+}
+
+/*
+ * n pixels of src through the palette, each written k times to out, the
+ * common scales unrolled. every row but the reserve ships' is one gel.
+ */
+static void
+colour(const uint8_t *src, const uint32_t *palette, uint32_t *out, int n, int k) {
+	switch (k) {
+		case 1:
+			for (int x = 0; x < n; x++)
+				out[x] = palette[src[x]];
+			break;
+		case 2:
+			for (int x = 0; x < n; x++)
+				out[x * 2] = out[x * 2 + 1] = palette[src[x]];
+			break;
+		case 4:
+			for (int x = 0; x < n; x++)
+				out[x * 4] = out[x * 4 + 1] = out[x * 4 + 2] = out[x * 4 + 3] = palette[src[x]];
+			break;
+		default:
+			for (int x = 0; x < n; x++) {
+				for (int i = 0; i < k; i++)
+					out[x * k + i] = palette[src[x]];
+			}
+	}
+}
+
+// the same for a row that changes gel, wide is 1 when src is twice the tint's width
+static void
+colour_mixed(const uint8_t *src, const uint8_t *tint, int wide, uint32_t (*palette)[256], uint32_t *out, int n, int k) {
+	for (int x = 0; x < n; x++) {
+		uint32_t c = palette[tint[x >> wide]][src[x]];
+		for (int i = 0; i < k; i++)
+			out[x * k + i] = c;
+	}
+}
+
+// output rows for source rows y0 to y1, a row repeated with the same shade is copied
+static void
+scale(struct Filter *f, int y0, int y1) {
+	int s = f->config.scale;
+	int smooth = f->smooth != NULL;
+	int k = smooth ? s / 2 : s; // repeats of each smoothed or source pixel
+	int n = smooth ? W * 2 : W;
+
+	for (int y = y0 * s; y < y1 * s; y++) {
+		int sy = y / s;
+		int j = y % s;
+		uint32_t *out = &f->out[(size_t)y * f->pitch];
+
+		int same = smooth ? j % k != 0 : j != 0;
+		if (same && f->shade[j] == f->shade[j - 1]) {
+			memcpy(out, out - f->pitch, W * s * sizeof(out[0]));
+			continue;
+		}
+		const uint8_t *src = smooth ? f->smooth[sy * 2 + j / k] : f->glow[sy];
+		if (f->gel[sy] < 0)
+			colour_mixed(src, f->tint[sy], smooth, f->palette[f->shade[j]], out, n, k);
+		else
+			colour(src, f->palette[f->shade[j]][f->gel[sy]], out, n, k);
+	}
+}
+
+#ifndef WEB
+static void
+meet(struct Filter *f) {
+	pthread_mutex_lock(&f->lock);
+	unsigned generation = f->generation;
+	if (++f->waiting == f->nthreads) {
+		f->waiting = 0;
+		f->generation++;
+		pthread_cond_broadcast(&f->met);
+	} else {
+		while (generation == f->generation)
+			pthread_cond_wait(&f->met, &f->lock);
+	}
+	pthread_mutex_unlock(&f->lock);
+}
+#endif
+
+static void
+band(struct Filter *f, int i) {
+	int y0 = i * H / f->nthreads;
+	int y1 = (i + 1) * H / f->nthreads;
+
+	expand(f, y0, y1);
+	persist(f, y0, y1);
+#ifndef WEB
+	// scale2x reads the rows either side of the band
+	if (f->nthreads > 1)
+		meet(f);
+#endif
+	if (f->smooth)
+		scale2x(f, y0, y1);
+	scale(f, y0, y1);
+}
+
+#ifndef WEB
+static void *
+work(void *arg) {
+	struct FilterBand *b = arg;
+
+	for (;;) {
+		meet(b->f);
+		if (b->f->stop)
+			break;
+		band(b->f, b->i);
+		meet(b->f);
+	}
+	return NULL;
+}
+#endif
+
+int
+filter_init(struct Filter *f, const struct FilterConfig *config, int threads) {
+	memset(f, 0, sizeof(*f));
+	f->config = *config;
+	if (f->config.scale < 1)
+		f->config.scale = 1;
+	if (f->config.scale > FILTER_MAX_SCALE)
+		f->config.scale = FILTER_MAX_SCALE;
+	if (f->config.scale % 2)
+		f->config.smooth = 0;
+	if (f->config.smooth && (f->smooth = malloc(H * 2 * sizeof(f->smooth[0]))) == NULL)
+		return 1;
+
+	for (int i = 0; i < 256; i++) {
+		for (int j = 0; j < 8; j++)
+			f->bytes[i][j] = -((i >> j) & 1);
+	}
+	for (int y = 0; y < H; y++) {
+		for (int x = 0; x < W; x++)
+			f->tint[y][x] = f->config.gel ? gel(x, y) : GEL_NONE;
+		f->gel[y] = f->tint[y][0];
+		for (int x = 0; x < W; x++) {
+			if (f->tint[y][x] != f->tint[y][0])
+				f->gel[y] = -1;
+		}
+	}
+	if (f->config.scale > 1 && f->config.scanlines < 100)
+		f->shade[f->config.scale - 1] = 1;
+
+	for (int shade = 0; shade < 2; shade++) {
+		uint32_t bright = shade ? f->config.scanlines * 256 / 100 : 256;
+		for (int g = 0; g < 3; g++) {
+			uint32_t r = gels[g] >> 16 & 0xff, gr = gels[g] >> 8 & 0xff, b = gels[g] & 0xff;
+			for (int i = 0; i < 256; i++) {
+				uint32_t v = i * bright >> 8;
+				f->palette[shade][g][i] = ((r * v + r) >> 8) << 16 | ((gr * v + gr) >> 8) << 8 | (b * v + b) >> 8;
+			}
+		}
+	}
+
+#ifdef WEB
+	(void)threads;
+	f->nthreads = 1;
+#else
+	f->nthreads = threads < 1 ? 1 : threads > FILTER_THREADS ? FILTER_THREADS : threads;
+	if (f->nthreads > 1) {
+		pthread_mutex_init(&f->lock, NULL);
+		pthread_cond_init(&f->met, NULL);
+		for (int i = 1; i < f->nthreads; i++) {
+			f->bands[i] = (struct FilterBand){ f, i };
+			pthread_create(&f->threads[i], NULL, work, &f->bands[i]);
+		}
+	}
+#endif
+	return 0;
+}
+
+void
+filter_free(struct Filter *f) {
+#ifndef WEB
+	if (f->nthreads > 1) {
+		f->stop = 1;
+		meet(f);
+		for (int i = 1; i < f->nthreads; i++)
+			pthread_join(f->threads[i], NULL);
+		pthread_mutex_destroy(&f->lock);
+		pthread_cond_destroy(&f->met);
+	}
+#endif
+	free(f->smooth);
+	f->smooth = NULL;
+}
+
+// one frame of video ram into out, FILTER_WIDTH * scale wide and pitch pixels apart
+void
+filter_run(struct Filter *f, const uint8_t *vram, uint32_t *out, int pitch) {
+	f->vram = vram;
+	f->out = out;
+	f->pitch = pitch;
+
+#ifndef WEB
+	if (f->nthreads > 1) {
+		meet(f);
+		band(f, 0);
+		meet(f);
+		return;
+	}
+#endif
+	band(f, 0);
+}
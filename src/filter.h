@@ -0,0 +1,57 @@
+#include <stdint.h>
+#ifndef WEB
+#include <pthread.h>
+#endif
+
+#define FILTER_WIDTH 224 // upright
+#define FILTER_HEIGHT 256
+#define FILTER_MAX_SCALE 8
+#define FILTER_THREADS 8
+
+struct FilterConfig {
+	int scale; // 1 to FILTER_MAX_SCALE
+	int smooth; // scale2x first, for even scales
+	int scanlines; // brightness of the last row of each scaled line in percent, 100 for none
+	int persistence; // 0 to 255, how much of the last frame's glow a pixel keeps
+	int gel; // the cabinet's red and green overlay
+};
+
+/*
+ * video ram to ARGB in stages: expand to upright 8 bit, phosphor glow,
+ * scale2x, then scale, tint and shade into the output. every stage works
+ * a band of rows, the caller and up to FILTER_THREADS - 1 workers taking
+ * one each. loops are kept simple enough for the vectoriser.
+ */
+struct Filter {
+	struct FilterConfig config;
+	uint8_t bytes[256][8]; // 0 or 255 for each bit
+	uint8_t lum[FILTER_HEIGHT][FILTER_WIDTH];
+	uint8_t glow[FILTER_HEIGHT][FILTER_WIDTH]; // lum with persistence, carried between frames
+	uint8_t (*smooth)[FILTER_WIDTH * 2]; // FILTER_HEIGHT * 2 rows when smoothing
+	uint8_t tint[FILTER_HEIGHT][FILTER_WIDTH]; // which gel covers each pixel
+	int8_t gel[FILTER_HEIGHT]; // the one gel over a row, -1 where it changes
+	uint8_t shade[FILTER_MAX_SCALE]; // per row of a scaled line, 1 for a scanline
+	uint32_t palette[2][3][256]; // shade, gel, glow to the colour out
+
+	const uint8_t *vram; // the frame being filtered
+	uint32_t *out;
+	int pitch; // in pixels
+
+	int nthreads;
+#ifndef WEB
+	struct FilterBand {
+		struct Filter *f;
+		int i;
+	} bands[FILTER_THREADS];
+	pthread_t threads[FILTER_THREADS];
+	pthread_mutex_t lock; // a barrier all the bands meet at, start, middle and end
+	pthread_cond_t met;
+	int waiting;
+	unsigned generation;
+	int stop;
+#endif
+};
+
+int filter_init(struct Filter *f, const struct FilterConfig *config, int threads);
+void filter_free(struct Filter *f);
+void filter_run(struct Filter *f, const uint8_t *vram, uint32_t *out, int pitch);
@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "machine.h"
+#include "snapshot.h"
+#include "clock.h"
+#include "profile.h"
+#include "trace.h"
+#include "analyse.h"
+#include "coverage.h"
+#include "capture.h"
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-f frames] [-b boot frames] [-c] [-s state] [-w state] [-j forks] [-v variant] [-t trace] [-C coverage] [-o capture] [-d] rom\n", name);
+	exit(1);
+}
+
+// the measured frames, merging what they executed into cover and capturing each into cap if given
+static int
+run(struct Machine *machine, int frames, uint64_t start, const char *cover, struct Capture *cap) {
+	uint64_t ready = clock_ns();
+
+	for (int i = 0; i < frames; i++) {
+		machine_frame(machine);
+		if (cap)
+			capture_frame(cap, &machine->cpu->ram[0x2400]);
+	}
+
+	uint64_t end = clock_ns();
+	printf("pid %d: ready after %.1f us, %d frames in %.1f ms, vram %016llx\n",
+		(int)getpid(), (ready - start) / 1e3, frames, (end - ready) / 1e6,
+		(unsigned long long)rom_hash(&machine->cpu->ram[0x2400], 0x1c00));
+	if (machine->emulate == emulate_profiled)
+		profile_report(machine->cpu->ram, 40);
+	return cover ? coverage_merge(coverage, cover) : 0;
+}
+
+/*
+ * runs the cabinet without a window. the state after -b frames can be
+ * cached on disk per rom (-c), or any saved state started from (-s), and
+ * -j forks that many runs from the prepared process, sharing its pages
+ * copy-on-write instead of booting each one. -v picks the emulate()
+ * variant for those frames; profiled prints a report after them, and
+ * -t records them to a binary trace for tools/trace.c to print. -C ors
+ * the addresses they executed into a coverage file, forks included.
+ * -o captures every measured frame on worker threads, to a directory of
+ * pngs, a .y4m or .raw stream or a .siv recording; when the workers fall behind the run
+ * waits for them, or with -d drops the frame. -t, -o and -w (save the
+ * state after the run) need a single run and can't be given with -j.
+ */
+int
+main(int argc, char **argv) {
+	uint64_t start = clock_ns();
+	int frames = 600;
+	int boot = 256;
+	int cached = 0;
+	int forks = 0;
+	char *load = NULL;
+	char *save = NULL;
+	char *variant = "plain";
+	char *trace = NULL;
+	char *cover = NULL;
+	char *capture = NULL;
+	enum CAPTURE_POLICY policy = CAPTURE_BLOCK;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:b:cs:w:j:v:t:C:o:d")) != -1) {
+		switch (opt) {
+			case 'f': frames = atoi(optarg); break;
+			case 'b': boot = atoi(optarg); break;
+			case 'c': cached = 1; break;
+			case 's': load = optarg; break;
+			case 'w': save = optarg; break;
+			case 'j': forks = atoi(optarg); break;
+			case 'v': variant = optarg; break;
+			case 't': trace = optarg; variant = "traced"; break;
+			case 'C': cover = optarg; variant = "coverage"; break;
+			case 'o': capture = optarg; break;
+			case 'd': policy = CAPTURE_DROP; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc || ((trace || capture || save) && forks))
+		usage(argv[0]);
+
+	struct Machine cabinet = {0};
+	if (machine_init(&cabinet, argv[optind]))
+		return 1;
+
+	emulate_fn fn = emulate_variant(variant);
+	if (fn == NULL) {
+		fprintf(stderr, "unknown variant %s\n", variant);
+		return 1;
+	}
+
+	struct Snapshot *snap = malloc(sizeof(*snap));
+	uint64_t rom = rom_hash(cabinet.cpu->ram, 0x2000);
+	char path[1024];
+	char name[32];
+
+	snprintf(name, sizeof(name), "boot-%d.snap", boot);
+	if (load) {
+		if (snapshot_load(snap, load) || snap->rom != rom) {
+			fprintf(stderr, "%s: no snapshot of this rom\n", load);
+			return 1;
+		}
+		snapshot_restore(snap, &cabinet);
+	} else if (cached && cache_path(path, sizeof(path), rom, name) == 0 &&
+			snapshot_load(snap, path) == 0 && snap->rom == rom) {
+		snapshot_restore(snap, &cabinet);
+	} else {
+		for (int i = 0; i < boot; i++)
+			machine_frame(&cabinet);
+
+		if (cached && cache_path(path, sizeof(path), rom, name) == 0) {
+			snapshot_take(snap, &cabinet);
+			snapshot_save(snap, path);
+		}
+	}
+
+	// boot plain, run the measured frames on the chosen variant
+	cabinet.emulate = fn;
+	if (forks == 0) {
+		struct Tracer *t = NULL;
+		if (trace && (t = trace_open(trace)) == NULL)
+			return 1;
+		struct Capture *cap = NULL;
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (capture && (cap = capture_open(capture, capture_format(capture), policy, 64, cpus > 1 ? cpus - 1 : 1)) == NULL)
+			return 1;
+		int failed = run(&cabinet, frames, start, cover, cap);
+		trace_close(t);
+		failed |= capture_close(cap);
+		if (failed)
+			return 1;
+		if (save) {
+			snapshot_take(snap, &cabinet);
+			return snapshot_save(snap, save);
+		}
+		return 0;
+	}
+
+	fflush(stdout);
+	for (int i = 0; i < forks; i++) {
+		uint64_t t = clock_ns();
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (pid == 0) {
+			int failed = run(&cabinet, frames, t, cover, NULL);
+			fflush(stdout);
+			_exit(failed);
+		}
+	}
+
+	int status;
+	int failed = 0;
+	while (wait(&status) > 0) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	}
+	return failed;
+}
@@ -0,0 +1,282 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "machine.h"
+#include "lockstep.h"
+#include "ram.h"
+#include "objects.h"
+#include "snapshot.h"
+#include "invaders.h"
+
+extern const int CYCLES_PER_FRAME;
+
+// port 1 bits, see get_input()
+enum BUTTONS {
+	COIN = 0x1 << 0,
+	START = 0x1 << 2,
+	SHOOT = 0x1 << 4,
+	MOVE_LEFT = 0x1 << 5,
+	MOVE_RIGHT = 0x1 << 6,
+};
+
+const uint8_t invaders_buttons[ACTIONS] = {
+	[NOOP] = 0,
+	[LEFT] = MOVE_LEFT,
+	[RIGHT] = MOVE_RIGHT,
+	[FIRE] = SHOOT,
+	[LEFT_FIRE] = MOVE_LEFT | SHOOT,
+	[RIGHT_FIRE] = MOVE_RIGHT | SHOOT,
+};
+
+// frames allowed for the self test, attract mode and credit before giving up
+static const int BOOT_FRAMES = 2000;
+
+static int
+bcd(uint8_t x) {
+	return (x >> 4) * 10 + (x & 0xf);
+}
+
+int
+invaders_init(struct Invaders *env, char *rom, enum OBSERVATION obs) {
+	memset(env, 0, sizeof(*env));
+	if (machine_init(&env->machine, rom))
+		return 1;
+
+	memcpy(env->rom, env->machine.cpu->ram, sizeof(env->rom));
+	env->obs = obs;
+	return 0;
+}
+
+void
+invaders_free(struct Invaders *env) {
+	free(env->start);
+	free(env->machine.cpu->ram);
+	free(env->machine.cpu);
+}
+
+size_t
+invaders_obs_size(enum OBSERVATION obs) {
+	switch (obs) {
+		case OBS_VRAM:
+			return VRAM_SIZE;
+		case OBS_GREY:
+			return GREY_WIDTH * GREY_HEIGHT;
+		case OBS_OBJECTS:
+			return sizeof(struct Objects);
+		default:
+			return 0;
+	}
+}
+
+/*
+ * video ram holds 224 columns of 256 pixels, bottom to top, lsb first.
+ * each output pixel averages a 2x2 block, which is a bit pair in two
+ * neighbouring columns of the same byte.
+ */
+static void
+observe_grey(uint8_t *fb, uint8_t *out) {
+	static const uint8_t level[] = { 0, 63, 127, 191, 255 };
+
+	for (int x = 0; x < GREY_WIDTH; x++) {
+		uint8_t *col = &fb[2 * x * 32];
+		for (int k = 0; k < 32; k++) {
+			uint8_t b0 = col[k];
+			uint8_t b1 = col[k + 32];
+			for (int j = 0; j < 4; j++) {
+				int n = ((b0 >> 2 * j) & 1) + ((b0 >> (2 * j + 1)) & 1) +
+					((b1 >> 2 * j) & 1) + ((b1 >> (2 * j + 1)) & 1);
+				int y = GREY_HEIGHT - 1 - 4 * k - j;
+				out[y * GREY_WIDTH + x] = level[n];
+			}
+		}
+	}
+}
+
+static void
+observe(struct Invaders *env, uint8_t *obs) {
+	uint8_t *ram = env->machine.cpu->ram;
+
+	env->score = bcd(ram[P1_SCORE + 1]) * 100 + bcd(ram[P1_SCORE]);
+	env->lives = ram[P1_SHIPS];
+	env->done = ram[GAME_MODE] == 0;
+
+	if (obs == NULL)
+		return;
+
+	switch (env->obs) {
+		case OBS_VRAM:
+			memcpy(obs, &ram[VRAM], VRAM_SIZE);
+			break;
+		case OBS_GREY:
+			observe_grey(&ram[VRAM], obs);
+			break;
+		case OBS_OBJECTS:
+			objects_decode(ram, (struct Objects *)obs);
+			break;
+		default:
+			break;
+	}
+}
+
+// powers the cabinet up again and plays through attract mode into a game
+static int
+start_game(struct Invaders *env) {
+	struct Machine *machine = &env->machine;
+	struct CPU *cpu = machine->cpu;
+	uint8_t *ram = cpu->ram;
+
+	memcpy(ram, env->rom, sizeof(env->rom));
+	memset(&ram[sizeof(env->rom)], 0, MEMORY_SIZE - sizeof(env->rom));
+	memset(machine->iports, 0, sizeof(machine->iports));
+	memset(machine->oports, 0, sizeof(machine->oports));
+	machine->shift = 0;
+	machine->offset = 0;
+
+	struct CPU reset = {0};
+	reset.ram = cpu->ram;
+	memcpy(reset.iports, cpu->iports, sizeof(reset.iports));
+	memcpy(reset.oports, cpu->oports, sizeof(reset.oports));
+	*cpu = reset;
+
+	// pulse the coin switch until credited, then the start button
+	for (int frame = 0; ram[GAME_MODE] != 1; frame++) {
+		if (frame == BOOT_FRAMES) {
+			fprintf(stderr, "invaders: no game started after %d frames\n", BOOT_FRAMES);
+			return 1;
+		}
+
+		uint8_t press = ram[NUM_COINS] ? START : COIN;
+		machine->iports[1] = (frame & 8) ? press : 0;
+		machine_frame(machine);
+	}
+
+	machine->iports[1] = 0;
+	return 0;
+}
+
+/*
+ * the game start is identical every time, so it is played through once,
+ * or loaded from the snapshot cache, and restored on every reset after.
+ */
+int
+invaders_reset(struct Invaders *env, uint8_t *obs) {
+	if (env->start == NULL) {
+		uint64_t rom = rom_hash(env->rom, sizeof(env->rom));
+		char path[1024];
+		int cached = cache_path(path, sizeof(path), rom, "start.snap") == 0;
+
+		env->start = malloc(sizeof(*env->start));
+		if (!cached || snapshot_load(env->start, path) || env->start->rom != rom) {
+			if (start_game(env)) {
+				free(env->start);
+				env->start = NULL;
+				return 1;
+			}
+			snapshot_take(env->start, &env->machine);
+			if (cached)
+				snapshot_save(env->start, path);
+		}
+	}
+
+	snapshot_restore(env->start, &env->machine);
+	observe(env, obs);
+	return 0;
+}
+
+void
+invaders_step(struct Invaders *env, enum ACTION action, int frameskip, uint8_t *obs, struct Step *step) {
+	int score = env->score;
+
+	env->machine.iports[1] = invaders_buttons[action];
+	for (int i = 0; i < frameskip; i++) {
+		machine_frame(&env->machine);
+		if (env->machine.cpu->ram[GAME_MODE] == 0)
+			break;
+	}
+
+	observe(env, obs);
+	step->reward = env->score - score;
+	step->score = env->score;
+	step->lives = env->lives;
+	step->done = env->done;
+}
+
+static void
+shift(void *arg) {
+	shift_register(arg);
+}
+
+/*
+ * steps n environments. groups of LANES cabinets run through the lockstep
+ * core, which executes an instruction once for every cabinet at that pc.
+ * a cabinet whose game ends leaves its group after that frame, so every
+ * environment ends up where invaders_step() would have left it.
+ */
+void
+invaders_step_batch(struct Invaders *envs, int n, const enum ACTION *actions, int frameskip, uint8_t *obs, struct Step *steps) {
+	size_t size = invaders_obs_size(envs[0].obs);
+
+	for (int first = 0; first < n; first += LANES) {
+		int lanes = n - first < LANES ? n - first : LANES;
+		struct CPU *cpus[LANES];
+		struct Lockstep ls;
+		int score[LANES];
+
+		for (int i = 0; i < lanes; i++) {
+			struct Invaders *env = &envs[first + i];
+			env->machine.iports[1] = invaders_buttons[actions[first + i]];
+			cpus[i] = env->machine.cpu;
+			score[i] = env->score;
+		}
+
+		// the lanes still playing, by index into this group
+		int playing[LANES];
+		int nplaying = lanes;
+		for (int i = 0; i < lanes; i++)
+			playing[i] = i;
+
+		for (int frame = 0; frame < frameskip && nplaying; frame++) {
+			struct CPU *running[LANES];
+			for (int i = 0; i < nplaying; i++)
+				running[i] = cpus[playing[i]];
+			if (frame == 0 || nplaying < ls.lanes) {
+				lockstep_init(&ls, running, nplaying);
+				ls.io = shift;
+				for (int i = 0; i < nplaying; i++)
+					ls.arg[i] = &envs[first + playing[i]].machine;
+			}
+
+			for (int interrupt = 1; interrupt <= 2; interrupt++) {
+				lockstep_run(&ls, CYCLES_PER_FRAME / 2);
+				lockstep_store(&ls);
+				for (int i = 0; i < nplaying; i++) {
+					if (running[i]->interrupts)
+						generate_interrupt(running[i], interrupt);
+				}
+				lockstep_load(&ls);
+			}
+
+			// a lane whose game ended stops there, as invaders_step() does
+			int n = 0;
+			for (int i = 0; i < nplaying; i++) {
+				if (running[i]->ram[GAME_MODE])
+					playing[n++] = playing[i];
+			}
+			nplaying = n;
+		}
+
+		for (int i = 0; i < lanes; i++) {
+			struct Invaders *env = &envs[first + i];
+			struct Step *step = &steps[first + i];
+
+			observe(env, obs ? obs + (first + i) * size : NULL);
+			step->reward = env->score - score[i];
+			step->score = env->score;
+			step->lives = env->lives;
+			step->done = env->done;
+		}
+	}
+}
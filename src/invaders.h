@@ -0,0 +1,55 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libinvaders: the cabinet as a reinforcement-learning environment.
+ * observations are written straight into caller-provided buffers of
+ * invaders_obs_size() bytes, rewards and lives are decoded from work ram.
+ */
+
+enum ACTION {
+	NOOP,
+	LEFT,
+	RIGHT,
+	FIRE,
+	LEFT_FIRE,
+	RIGHT_FIRE,
+	ACTIONS,
+};
+
+enum OBSERVATION {
+	OBS_NONE,
+	OBS_VRAM, // packed 1bpp video ram as the cabinet stores it, rotated
+	OBS_GREY, // upright greyscale, 2x2 downsampled, one byte per pixel
+	OBS_OBJECTS, // struct Objects decoded from work ram, nothing rendered
+};
+
+#define GREY_WIDTH (224 / 2)
+#define GREY_HEIGHT (256 / 2)
+
+struct Invaders {
+	struct Machine machine;
+	enum OBSERVATION obs;
+	uint8_t rom[0x2000];
+	struct Snapshot *start; // the first reset's game start, later resets restore it
+
+	int score;
+	int lives;
+	int done;
+};
+
+struct Step {
+	int reward;
+	int score;
+	int lives;
+	int done;
+};
+
+extern const uint8_t invaders_buttons[ACTIONS]; // the port 1 bits each action holds down
+
+int invaders_init(struct Invaders *env, char *rom, enum OBSERVATION obs);
+void invaders_free(struct Invaders *env);
+size_t invaders_obs_size(enum OBSERVATION obs);
+int invaders_reset(struct Invaders *env, uint8_t *obs);
+void invaders_step(struct Invaders *env, enum ACTION action, int frameskip, uint8_t *obs, struct Step *step);
+void invaders_step_batch(struct Invaders *envs, int n, const enum ACTION *actions, int frameskip, uint8_t *obs, struct Step *steps);
@@ -0,0 +1,281 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "lockstep.h"
+
+enum { B, C, D, E, H, L, M, A };
+
+static void
+lane_load(struct Lockstep *ls, int i) {
+	struct CPU *cpu = ls->cpu[i];
+	ls->r[B][i] = cpu->b;
+	ls->r[C][i] = cpu->c;
+	ls->r[D][i] = cpu->d;
+	ls->r[E][i] = cpu->e;
+	ls->r[H][i] = cpu->h;
+	ls->r[L][i] = cpu->l;
+	ls->r[A][i] = cpu->a;
+	ls->sp[i] = cpu->sp;
+	ls->pc[i] = cpu->pc;
+	ls->fz[i] = cpu->flags.z;
+	ls->fs[i] = cpu->flags.s;
+	ls->fp[i] = cpu->flags.p;
+	ls->fa[i] = cpu->flags.a;
+	ls->fc[i] = cpu->flags.c;
+}
+
+static void
+lane_store(struct Lockstep *ls, int i) {
+	struct CPU *cpu = ls->cpu[i];
+	cpu->b = ls->r[B][i];
+	cpu->c = ls->r[C][i];
+	cpu->d = ls->r[D][i];
+	cpu->e = ls->r[E][i];
+	cpu->h = ls->r[H][i];
+	cpu->l = ls->r[L][i];
+	cpu->a = ls->r[A][i];
+	cpu->sp = ls->sp[i];
+	cpu->pc = ls->pc[i];
+	cpu->flags.z = ls->fz[i];
+	cpu->flags.s = ls->fs[i];
+	cpu->flags.p = ls->fp[i];
+	cpu->flags.a = ls->fa[i];
+	cpu->flags.c = ls->fc[i];
+}
+
+int
+lockstep_init(struct Lockstep *ls, struct CPU **cpus, int lanes) {
+	if (lanes < 1 || lanes > LANES) {
+		fprintf(stderr, "lockstep: %d lanes requested, %d supported\n", lanes, LANES);
+		return 1;
+	}
+
+	memset(ls, 0, sizeof(*ls));
+	ls->lanes = lanes;
+	for (int i = 0; i < lanes; i++)
+		ls->cpu[i] = cpus[i];
+
+	lockstep_load(ls);
+	return 0;
+}
+
+// pull registers from the lanes' CPUs, e.g. after generate_interrupt()
+void
+lockstep_load(struct Lockstep *ls) {
+	for (int i = 0; i < ls->lanes; i++)
+		lane_load(ls, i);
+}
+
+// push registers back to the lanes' CPUs
+void
+lockstep_store(struct Lockstep *ls) {
+	for (int i = 0; i < ls->lanes; i++)
+		lane_store(ls, i);
+}
+
+static uint8_t
+even(uint8_t x) {
+	x ^= x >> 4;
+	x ^= x >> 2;
+	x ^= x >> 1;
+	return !(x & 1);
+}
+
+// length of the instructions the vector path handles, 0 for the rest
+static int
+vector_len(uint8_t op) {
+	uint8_t d = (op >> 3) & 7;
+	uint8_t s = op & 7;
+
+	if (op == 0x00) // NOP
+		return 1;
+	if ((op & 0xcf) == 0x01) // LXI
+		return 3;
+	if ((op & 0xc7) == 0x03) // INX, DCX
+		return 1;
+	if ((op & 0xc6) == 0x04 && d != M) // INR, DCR
+		return 1;
+	if ((op & 0xc7) == 0x06 && d != M) // MVI
+		return 2;
+	if ((op & 0xc0) == 0x40 && d != M && s != M && op != 0x7f) // MOV
+		return 1;
+	if (op >= 0xa0 && op <= 0xbf && s != M) // ANA, XRA, ORA, CMP
+		return 1;
+	if (op == 0xc3 || (op & 0xc7) == 0xc2) // JMP, Jcc
+		return 3;
+	return 0;
+}
+
+// applies op to every lane set in m, mirroring emulate() bit for bit
+static void
+vector_exec(struct Lockstep *ls, const uint8_t *op, const uint8_t *m) {
+	uint8_t d = (op[0] >> 3) & 7;
+	uint8_t s = op[0] & 7;
+	uint16_t next[LANES];
+
+	for (int i = 0; i < LANES; i++)
+		next[i] = ls->pc[i] + vector_len(op[0]);
+
+	if ((op[0] & 0xcf) == 0x01) { // LXI
+		if (d == 6) {
+			for (int i = 0; i < LANES; i++)
+				ls->sp[i] = m[i] ? (op[2] << 8 | op[1]) : ls->sp[i];
+		} else {
+			for (int i = 0; i < LANES; i++) {
+				ls->r[d][i] = m[i] ? op[2] : ls->r[d][i];
+				ls->r[d + 1][i] = m[i] ? op[1] : ls->r[d + 1][i];
+			}
+		}
+	} else if ((op[0] & 0xc7) == 0x03) { // INX, DCX
+		int delta = (op[0] & 0x08) ? -1 : 1;
+		int hi = d & 6;
+		if (hi == 6) {
+			for (int i = 0; i < LANES; i++)
+				ls->sp[i] += m[i] ? delta : 0;
+		} else {
+			for (int i = 0; i < LANES; i++) {
+				uint16_t rp = (ls->r[hi][i] << 8 | ls->r[hi + 1][i]) + (m[i] ? delta : 0);
+				ls->r[hi][i] = rp >> 8;
+				ls->r[hi + 1][i] = rp & 0xff;
+			}
+		}
+	} else if ((op[0] & 0xc6) == 0x04) { // INR, DCR
+		int delta = (op[0] & 0x01) ? -1 : 1;
+		for (int i = 0; i < LANES; i++) {
+			uint8_t v = ls->r[d][i] + delta;
+			ls->r[d][i] = m[i] ? v : ls->r[d][i];
+			ls->fz[i] = m[i] ? v == 0 : ls->fz[i];
+			ls->fs[i] = m[i] ? v >> 7 : ls->fs[i];
+			ls->fp[i] = m[i] ? even(v) : ls->fp[i];
+			uint8_t fa = delta > 0 ? (v & 0xf) == 0 : (v & 0xf) != 0xf;
+			ls->fa[i] = m[i] ? fa : ls->fa[i];
+		}
+	} else if ((op[0] & 0xc7) == 0x06) { // MVI
+		for (int i = 0; i < LANES; i++)
+			ls->r[d][i] = m[i] ? op[1] : ls->r[d][i];
+	} else if ((op[0] & 0xc0) == 0x40) { // MOV
+		for (int i = 0; i < LANES; i++)
+			ls->r[d][i] = m[i] ? ls->r[s][i] : ls->r[d][i];
+	} else if (op[0] >= 0xa0 && op[0] < 0xb8) { // ANA, XRA, ORA
+		for (int i = 0; i < LANES; i++) {
+			uint8_t a = ls->r[A][i];
+			uint8_t v = d == 4 ? a & ls->r[s][i] : d == 5 ? a ^ ls->r[s][i] : a | ls->r[s][i];
+			ls->r[A][i] = m[i] ? v : a;
+			ls->fz[i] = m[i] ? v == 0 : ls->fz[i];
+			ls->fs[i] = m[i] ? v >> 7 : ls->fs[i];
+			ls->fp[i] = m[i] ? even(v) : ls->fp[i];
+			ls->fa[i] = m[i] ? d == 4 && ((a | ls->r[s][i]) & 0x08) : ls->fa[i];
+			ls->fc[i] = m[i] ? 0 : ls->fc[i];
+		}
+	} else if (op[0] >= 0xb8 && op[0] <= 0xbf) { // CMP
+		for (int i = 0; i < LANES; i++) {
+			uint8_t a = ls->r[A][i];
+			uint8_t r = ls->r[s][i];
+			uint8_t v = a - r;
+			ls->fz[i] = m[i] ? v == 0 : ls->fz[i];
+			ls->fs[i] = m[i] ? v >> 7 : ls->fs[i];
+			ls->fp[i] = m[i] ? even(v) : ls->fp[i];
+			ls->fa[i] = m[i] ? (a & 0xf) + (~r & 0xf) + 1 > 0xf : ls->fa[i];
+			ls->fc[i] = m[i] ? a < r : ls->fc[i];
+		}
+	} else if (op[0] == 0xc3) { // JMP
+		for (int i = 0; i < LANES; i++)
+			next[i] = op[2] << 8 | op[1];
+	} else if ((op[0] & 0xc7) == 0xc2) { // Jcc
+		uint8_t *flag = (d >> 1) == 0 ? ls->fz : (d >> 1) == 1 ? ls->fc : (d >> 1) == 2 ? ls->fp : ls->fs;
+		for (int i = 0; i < LANES; i++)
+			next[i] = flag[i] == (d & 1) ? (op[2] << 8 | op[1]) : next[i];
+	}
+
+	for (int i = 0; i < LANES; i++) {
+		ls->pc[i] = m[i] ? next[i] : ls->pc[i];
+		ls->cycles[i] += m[i] ? cycles8080[op[0]] : 0;
+	}
+}
+
+/*
+ * executes one instruction on every pending lane that shares the leader's
+ * pc and instruction bytes. lanes that have diverged are left pending for
+ * a later dispatch, lanes that meet again at a pc are merged back into one.
+ */
+static void
+dispatch(struct Lockstep *ls, int lead, uint8_t *pending) {
+	uint16_t pc = ls->pc[lead];
+	uint8_t *op = &ls->cpu[lead]->ram[pc];
+	int len = vector_len(op[0]);
+	uint8_t m[LANES] = {0};
+	int n = 0;
+
+	for (int i = 0; i < ls->lanes; i++) {
+		if (!pending[i] || ls->pc[i] != pc)
+			continue;
+		if (memcmp(&ls->cpu[i]->ram[pc], op, len ? len : 1))
+			continue;
+		m[i] = 1;
+		pending[i] = 0;
+		n++;
+	}
+
+	if (len) {
+		vector_exec(ls, op, m);
+		ls->vector += n;
+	} else {
+		for (int i = 0; i < ls->lanes; i++) {
+			if (!m[i])
+				continue;
+			lane_store(ls, i);
+			ls->cycles[i] += emulate(ls->cpu[i]);
+			if (ls->io)
+				ls->io(ls->arg[i]);
+			lane_load(ls, i);
+		}
+	}
+
+	ls->steps += n;
+	ls->groups++;
+}
+
+// steps every lane by exactly one instruction
+void
+lockstep_step(struct Lockstep *ls) {
+	uint8_t pending[LANES] = {0};
+
+	for (int i = 0; i < ls->lanes; i++)
+		pending[i] = 1;
+
+	for (int i = 0; i < ls->lanes; i++) {
+		if (pending[i])
+			dispatch(ls, i, pending);
+	}
+}
+
+/*
+ * runs every lane until it has used cycle_target cycles, like the loop in
+ * main() does for a single CPU. the group with the lowest pc goes first so
+ * lanes split by a branch catch up with each other and merge again.
+ */
+void
+lockstep_run(struct Lockstep *ls, int cycle_target) {
+	for (int i = 0; i < ls->lanes; i++)
+		ls->cycles[i] = 0;
+
+	while (1) {
+		uint8_t pending[LANES] = {0};
+		int lead = -1;
+
+		for (int i = 0; i < ls->lanes; i++) {
+			if (ls->cycles[i] >= cycle_target)
+				continue;
+			pending[i] = 1;
+			if (lead < 0 || ls->pc[i] < ls->pc[lead])
+				lead = i;
+		}
+
+		if (lead < 0)
+			break;
+
+		dispatch(ls, lead, pending);
+	}
+}
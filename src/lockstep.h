@@ -0,0 +1,44 @@
+#include <stdint.h>
+
+/*
+ * sixteen 16 bit program counters fill an AVX-512 register or two AVX2
+ * ones. fixed whatever -march a file is built with, struct Lockstep is part
+ * of libinvaders and its layout must not change with the consumer's flags.
+ */
+#define LANES 16
+
+/*
+ * experimental structure-of-arrays core: the registers of up to LANES
+ * cabinets are kept lane by lane so one instruction can be applied to every
+ * lane sharing a pc with plain loops the compiler vectorises. memory, ports
+ * and interrupts stay in each lane's own struct CPU, anything the vector
+ * path does not handle falls back to emulate() on that CPU.
+ */
+struct Lockstep {
+	uint8_t r[8][LANES]; // b c d e h l - a, indexed by the opcode register field
+	uint16_t sp[LANES];
+	uint16_t pc[LANES];
+	uint8_t fz[LANES];
+	uint8_t fs[LANES];
+	uint8_t fp[LANES];
+	uint8_t fa[LANES];
+	uint8_t fc[LANES];
+	int cycles[LANES];
+
+	struct CPU *cpu[LANES];
+	int lanes;
+
+	// called after every fallback instruction, e.g. to run shift_register()
+	void (*io)(void *arg);
+	void *arg[LANES];
+
+	uint64_t steps; // lane instructions executed
+	uint64_t groups; // dispatches needed to execute them
+	uint64_t vector; // lane instructions executed by the vector path
+};
+
+int lockstep_init(struct Lockstep *ls, struct CPU **cpus, int lanes);
+void lockstep_load(struct Lockstep *ls);
+void lockstep_store(struct Lockstep *ls);
+void lockstep_step(struct Lockstep *ls);
+void lockstep_run(struct Lockstep *ls, int cycle_target);
@@ -1,10 +1,12 @@
-#include <SDL2/SDL_events.h>
-#include <SDL2/SDL_keyboard.h>
-#include <SDL2/SDL_keycode.h>
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#ifndef HEADLESS
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_keyboard.h>
+#include <SDL2/SDL_keycode.h>
 #include <SDL2/SDL.h>
+#endif
 
 #include "cpu.h"
 #include "machine.h"
@@ -12,10 +14,12 @@
 const int WIDTH = 224;
 const int HEIGHT = 256;
 const int SCALE = 2;
+const int CYCLES_PER_FRAME = 2000000 / 60;
 
 int
 machine_init(struct Machine *machine, char *filename) {
 	machine->cpu = calloc(1, sizeof(struct CPU));
+	machine->emulate = emulate;
 
 #ifndef WEB
 	FILE *f = fopen(filename, "r");
@@ -35,6 +39,7 @@ machine_init(struct Machine *machine, char *filename) {
 	return 0;
 }
 
+#ifndef HEADLESS
 void get_input(struct Machine *machine) {
 	SDL_Event e;
 	SDL_PollEvent(&e);
@@ -110,6 +115,36 @@ void get_input(struct Machine *machine) {
 		break;
 	}
 }
+#endif
+
+/*
+ * one 60Hz frame: the mid-screen interrupt halfway through, vblank at the
+ * end. every variant's emulate() returns the cycles it ran, never 0, the
+ * plain one is called directly rather than through machine->emulate.
+ */
+void
+machine_frame(struct Machine *machine) {
+	for (int interrupt = 1; interrupt <= 2; interrupt++) {
+		int cycles = 0;
+		int instructions = 0;
+		if (machine->emulate == emulate) {
+			for (; cycles < CYCLES_PER_FRAME / 2; instructions++) {
+				cycles += emulate(machine->cpu);
+				shift_register(machine);
+			}
+		} else {
+			for (; cycles < CYCLES_PER_FRAME / 2; instructions++) {
+				cycles += machine->emulate(machine->cpu);
+				shift_register(machine);
+			}
+		}
+		machine->cycles += cycles;
+		machine->instructions += instructions;
+
+		if (machine->cpu->interrupts)
+			generate_interrupt(machine->cpu, interrupt);
+	}
+}
 
 void
 machine_draw_surface(struct Machine *machine) {
@@ -1,18 +1,23 @@
 #include <stdint.h>
 struct Machine {
 	struct CPU *cpu;
+	emulate_fn emulate; // variant machine_frame() runs, emulate by default
 
 	uint8_t iports[4];
 	uint8_t oports[7];
 	uint16_t shift;
 	uint8_t offset;
 
+	uint64_t instructions; // executed by machine_frame()
+	uint64_t cycles;
+
 	uint32_t *framebuffer;
 };
 
 int machine_init(struct Machine *machine, char *filename);
 void machine_draw_surface(struct Machine *machine);
 void get_input(struct Machine *machine);
+void machine_frame(struct Machine *machine);
 
 void shift_register(struct Machine *machine);
 void print_shift(struct Machine *machine);
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <SDL2/SDL_error.h>
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_surface.h>
@@ -5,19 +6,35 @@
 #include <sys/time.h>
 #include <stdint.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
 #include <SDL2/SDL.h>
 
 #include "dissasemble.h"
 #include "cpu.h"
 #include "machine.h"
+#include "profile.h"
+#include "audio.h"
+#include "filter.h"
+#include "present.h"
+#include "clock.h"
+#include "telemetry.h"
+#include "debugger.h"
+#include "watch.h"
 
-extern const int WIDTH;
-extern const int HEIGHT;
 extern const int SCALE;
+extern const int CYCLES_PER_FRAME;
 
 const int SCREEN_FPS = 60;
 const double MS_PER_FRAME = 1000.0 / 60.0 / 2; // reduce devision to 2 to prevent speedup
+const int FAST_FORWARD = 4;
 struct Machine cabinet = {0};
+struct Audio audio;
+struct Filter filter;
+struct Presenter screen;
+struct Debugger debugger;
+volatile sig_atomic_t interrupted;
 
 double
 getmsec() {
@@ -26,43 +43,195 @@ getmsec() {
 	return (double)time.tv_sec * 1000 + (time.tv_usec/1000.0);
 }
 
+static void
+report(void) {
+	profile_report(cabinet.cpu->ram, 40);
+}
+
+static void
+interrupt(int sig) {
+	(void)sig;
+	interrupted = 1;
+}
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-s scale] [-x] [-l scanlines] [-p persistence] [-g] [-t] [-e telemetry] [-d] [-w adr[-end]] rom [variant] [samples]\n", name);
+	exit(1);
+}
+
 int
 main(int argc, char **argv) {
+	struct FilterConfig config = { .scale = SCALE, .scanlines = 100, .gel = 1 };
+	int overlay = 0;
+	char *exported = NULL;
+	int debug = 0;
+	char *watches[WATCH_MAX];
+	int nwatches = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:xl:p:gte:dw:")) != -1) {
+		switch (opt) {
+			case 's': config.scale = atoi(optarg); break;
+			case 'x': config.smooth = 1; break;
+			case 'l': config.scanlines = atoi(optarg); break;
+			case 'p': config.persistence = atoi(optarg); break;
+			case 'g': config.gel = 0; break;
+			case 't': overlay = 1; break;
+			case 'e': exported = optarg; break;
+			case 'd': debug = 1; break;
+			case 'w':
+				if (nwatches < WATCH_MAX)
+					watches[nwatches++] = optarg;
+				break;
+			default: usage(argv[0]);
+		}
+	}
+	// the renderer scales to the window, the filters only as far as their effects need
+	int window = config.scale < 1 ? 1 : config.scale;
+	if (!config.smooth && config.scanlines >= 100)
+		config.scale = 1;
+
+	char **args = &argv[optind]; // rom, variant, samples
+	int nargs = argc - optind;
+
 #ifndef WEB
-	assert(machine_init(&cabinet, argv[1]) == 0);
+	if (nargs < 1)
+		usage(argv[0]);
+	assert(machine_init(&cabinet, args[0]) == 0);
 #else
 	assert(machine_init(&cabinet, NULL) == 0);
 #endif
+	if (nargs > 1) {
+		cabinet.emulate = emulate_variant(args[1]);
+		if (cabinet.emulate == NULL) {
+			fprintf(stderr, "unknown variant %s\n", args[1]);
+			return 1;
+		}
+		if (cabinet.emulate == emulate_profiled)
+			atexit(report);
+	}
+
+#ifndef WEB
+	// stopped before the first instruction, ctrl-c stops it again
+	if (debug) {
+		if (cabinet.emulate != emulate) {
+			fprintf(stderr, "-d swaps the variant out while stopped or stepping, use the plain one\n");
+			return 1;
+		}
+		debugger_open(&debugger, &cabinet, stdin, stdout);
+		debugger.interrupted = &interrupted;
+		debugger_break(&debugger);
+		signal(SIGINT, interrupt);
+	}
+	// writes to watched ram are printed as they happen
+	if (nwatches && watch_open(cabinet.cpu))
+		return 1;
+	for (int i = 0; i < nwatches; i++) {
+		char *end;
+		unsigned long lo = strtoul(watches[i], &end, 16);
+		unsigned long hi = lo;
+		if (*end == '-')
+			hi = strtoul(end + 1, &end, 16);
+		if (*end || lo > 0xffff || hi > 0xffff || watch_add(lo, hi)) {
+			fprintf(stderr, "can't watch %s\n", watches[i]);
+			return 1;
+		}
+	}
+#endif
+
+	if (filter_init(&filter, &config, sysconf(_SC_NPROCESSORS_ONLN))) {
+		fprintf(stderr, "unable to set up filters\n");
+		return 1;
+	}
+
+	if (audio_init(&audio, nargs > 2 ? args[2] : NULL)) {
+		fprintf(stderr, "unable to load sounds\n");
+		return 1;
+	}
 
 	if (SDL_Init(SDL_INIT_VIDEO)) {
 		fprintf(stderr, "unable to init SDL: %s\n", SDL_GetError());
 		return 1;
 	}
 
-	SDL_Window *win = SDL_CreateWindow("Space Invaders", 0, 0, WIDTH * SCALE, HEIGHT * SCALE, SDL_WINDOW_SHOWN);
+	int scale = filter.config.scale;
+	if (present_open(&screen, "Space Invaders", FILTER_WIDTH * scale, FILTER_HEIGHT * scale,
+			FILTER_WIDTH * window, FILTER_HEIGHT * window))
+		return 1;
 
-	if (win == NULL) {
-		fprintf(stderr, "unable to create sdl win: %s\n", SDL_GetError());
+	// counted only when shown or exported, a sample a second
+	struct Telemetry *telemetry = NULL;
+	struct TelemetryCounters *counters = NULL;
+	if ((overlay || exported) && (telemetry = telemetry_open(exported, 1000)) == NULL)
 		return 1;
-	}
+	if (telemetry)
+		counters = telemetry_thread(telemetry, "main");
+	char text[TELEMETRY_TEXT] = "";
 
-	cabinet.framebuffer = SDL_GetWindowSurface(win)->pixels; // destroy window will free the surface for us
+	// with sound the callback paces the frames, half a frame whenever the ring runs low
+	int sound = audio_open(&audio) == 0;
 
 	int cycles = 0;
 	double timer = getmsec();
 
 	int which = 1;
+	int half = 0;
 	while (1) {
-		double dt = getmsec() - timer;
-		if (dt < MS_PER_FRAME)
-			continue;
-		int cycle_target = dt * 2000; // 2000 cycles per milisecond
-
-		for (cycles = 0; cycles < cycle_target;) {
-			cycles += emulate(cabinet.cpu);
-			shift_register(&cabinet);
+		// tab fast forwards, the sound keeps its pitch
+		int speed = SDL_GetKeyboardState(NULL)[SDL_SCANCODE_TAB] ? FAST_FORWARD : 1;
+		audio.speed = speed;
+
+		int cycle_target;
+		if (sound) {
+			if (audio_fill(&audio) >= (uint32_t)audio.rate * AUDIO_LATENCY / 1000) {
+				SDL_Delay(1);
+				continue;
+			}
+			cycle_target = CYCLES_PER_FRAME / 2;
+		} else {
+			// fixed half frames against the clock, a vsynced present only delays the next
+			double dt = getmsec() - timer;
+			if (dt < MS_PER_FRAME / speed)
+				continue;
+			timer += MS_PER_FRAME / speed;
+			if (dt > 4 * MS_PER_FRAME)
+				timer = getmsec(); // fell far behind, don't race to catch up
+			cycle_target = CYCLES_PER_FRAME / 2;
 		}
 
+		if (interrupted) {
+			interrupted = 0;
+			debugger_break(&debugger);
+		}
+
+		uint64_t start = counters ? clock_ns() : 0;
+		uint64_t instructions = 0;
+		// the plain core is called directly so it can inline, other variants
+		// and an armed debugger go through the pointer
+		if (cabinet.emulate == emulate) {
+			for (cycles = 0; cycles < cycle_target; instructions++) {
+				cycles += emulate(cabinet.cpu);
+				shift_register(&cabinet);
+				if (cabinet.cpu->sound_written) {
+					audio_write(&audio, cycles, cabinet.oports[3], cabinet.oports[5]);
+					cabinet.cpu->sound_written = 0;
+				}
+			}
+		} else {
+			for (cycles = 0; cycles < cycle_target; instructions++) {
+				cycles += cabinet.emulate(cabinet.cpu);
+				shift_register(&cabinet);
+				if (cabinet.cpu->sound_written) {
+					audio_write(&audio, cycles, cabinet.oports[3], cabinet.oports[5]);
+					cabinet.cpu->sound_written = 0;
+				}
+			}
+		}
+		audio_mix(&audio, cycles);
+		if (nwatches)
+			watch_report(stdout);
+
 		if (cabinet.cpu->interrupts) {
 			if (which) {
 				generate_interrupt(cabinet.cpu, 1);
@@ -71,17 +240,50 @@ main(int argc, char **argv) {
 				generate_interrupt(cabinet.cpu, 2);
 				which = 1;
 			}
+			if (counters)
+				telemetry_interrupt(counters, cycles - cycle_target);
 		}
+		uint64_t emulated = counters ? clock_ns() : 0;
 
-		timer = getmsec();
-
-		machine_draw_surface(&cabinet);
-		SDL_UpdateWindowSurface(win);
+		// a frame every other half frame, so a vsynced present waits once per frame
+		half ^= 1;
+		int pitch;
+		uint32_t *pixels;
+		uint64_t drawn = emulated;
+		uint64_t presented = emulated;
+		if (half == 0 && (pixels = present_lock(&screen, &pitch)) != NULL) {
+			filter_run(&filter, &cabinet.cpu->ram[0x2400], pixels, pitch);
+			if (overlay) {
+				telemetry_text(telemetry, text);
+				telemetry_draw(text, pixels, pitch, FILTER_WIDTH * scale, FILTER_HEIGHT * scale, scale);
+			}
+			drawn = counters ? clock_ns() : 0;
+			present_frame(&screen);
+			presented = counters ? clock_ns() : 0;
+			if (counters)
+				telemetry_frame(counters, presented);
+		}
 
 		get_input(&cabinet);
+
+		if (counters) {
+			uint64_t now = clock_ns();
+			TELEMETRY_ADD(counters->instructions, instructions);
+			TELEMETRY_ADD(counters->cycles, cycles);
+			TELEMETRY_ADD(counters->ns[PHASE_EMULATE], emulated - start);
+			TELEMETRY_ADD(counters->ns[PHASE_DRAW], drawn - emulated);
+			TELEMETRY_ADD(counters->ns[PHASE_PRESENT], presented - drawn);
+			TELEMETRY_ADD(counters->ns[PHASE_INPUT], now - presented);
+			__atomic_store_n(&counters->underruns, __atomic_load_n(&audio.underruns, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+			telemetry_poll(telemetry);
+		}
 	}
 
-	SDL_DestroyWindow(win);
+	audio_close(&audio);
+	audio_free(&audio);
+	filter_free(&filter);
+	present_close(&screen);
+	telemetry_close(telemetry);
 	SDL_Quit();
 
 	return 0;
@@ -0,0 +1,58 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "ram.h"
+#include "objects.h"
+
+static uint16_t
+bcd(const uint8_t *x) {
+	return ((x[1] >> 4) * 10 + (x[1] & 0xf)) * 100 + (x[0] >> 4) * 10 + (x[0] & 0xf);
+}
+
+static void
+shot(const uint8_t *ram, int adr, struct Shot *shot) {
+	shot->status = ram[adr];
+	shot->y = ram[adr + 4];
+	shot->x = ram[adr + 5];
+}
+
+static void
+alien_shot(const uint8_t *ram, int adr, struct Shot *shot) {
+	shot->status = ram[adr];
+	shot->y = ram[adr + 8];
+	shot->x = ram[adr + 9];
+}
+
+void
+objects_decode(const uint8_t *ram, struct Objects *objects) {
+	int player = ram[PLAYER_DATA] == (P2_RACK >> 8);
+	int rack = player ? P2_RACK : P1_RACK;
+
+	objects->score[0] = bcd(&ram[P1_SCORE]);
+	objects->score[1] = bcd(&ram[P2_SCORE]);
+	objects->hi_score = bcd(&ram[HI_SCORE]);
+	objects->credits = (ram[NUM_COINS] >> 4) * 10 + (ram[NUM_COINS] & 0xf);
+	objects->game_mode = ram[GAME_MODE];
+	objects->player = player;
+	objects->ships = ram[player ? P2_SHIPS : P1_SHIPS];
+	objects->player_alive = ram[PLAYER_ALIVE] == 0xff;
+	objects->player_x = ram[PLAYER_X];
+	objects->rack_x = ram[REF_ALIEN_X];
+	objects->rack_y = ram[REF_ALIEN_Y];
+	objects->rack_direction = ram[RACK_DIRECTION];
+	objects->num_aliens = ram[NUM_ALIENS];
+	memcpy(objects->aliens, &ram[rack], ALIENS);
+	objects->saucer_active = ram[SAUCER_ACTIVE];
+
+	shot(ram, PLAYER_SHOT, &objects->shots[0]);
+	alien_shot(ram, ROLLING_SHOT, &objects->shots[1]);
+	alien_shot(ram, PLUNGER_SHOT, &objects->shots[2]);
+	alien_shot(ram, SQUIGGLY_SHOT, &objects->shots[3]);
+}
+
+// decodes n cabinets' memories into n consecutive structs
+void
+objects_decode_batch(uint8_t *const *rams, int n, struct Objects *objects) {
+	for (int i = 0; i < n; i++)
+		objects_decode(rams[i], &objects[i]);
+}
@@ -0,0 +1,33 @@
+#include <stdint.h>
+
+struct Shot {
+	uint8_t status;
+	uint8_t x;
+	uint8_t y;
+};
+
+/*
+ * the game state as the rom keeps it in work ram, decoded into a fixed
+ * layout of bytes so it can be copied, batched and fed to agents without
+ * rendering a single pixel.
+ */
+struct Objects {
+	uint16_t score[2];
+	uint16_t hi_score;
+	uint8_t credits;
+	uint8_t game_mode;
+	uint8_t player; // 0 or 1, whose rack and ships follow
+	uint8_t ships;
+	uint8_t player_alive;
+	uint8_t player_x;
+	uint8_t rack_x;
+	uint8_t rack_y;
+	uint8_t rack_direction;
+	uint8_t num_aliens;
+	uint8_t aliens[55]; // 1 while alive, bottom row first
+	uint8_t saucer_active;
+	struct Shot shots[4]; // player, rolling, plunger, squiggly
+};
+
+void objects_decode(const uint8_t *ram, struct Objects *objects);
+void objects_decode_batch(uint8_t *const *rams, int n, struct Objects *objects);
@@ -0,0 +1,133 @@
+#define _DEFAULT_SOURCE // syscall()
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perf.h"
+
+const char *perf_names[PERF_EVENTS] = {
+	[PERF_CYCLES] = "cycles",
+	[PERF_INSTRUCTIONS] = "instructions",
+	[PERF_BRANCH_MISSES] = "branch_misses",
+	[PERF_L1D_MISSES] = "l1d_misses",
+	[PERF_LLC_MISSES] = "llc_misses",
+};
+
+#ifdef __linux__
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} events[PERF_EVENTS] = {
+	[PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[PERF_L1D_MISSES] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+		PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+	[PERF_LLC_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+// what PERF_FORMAT_GROUP | TOTAL_TIME_* | ID reads back
+struct GroupRead {
+	uint64_t nr;
+	uint64_t enabled;
+	uint64_t running;
+	struct {
+		uint64_t value;
+		uint64_t id;
+	} values[PERF_EVENTS];
+};
+#endif
+
+// nonzero when no counter at all is available, every call after that does nothing
+int
+perf_open(struct Perf *p) {
+	p->leader = -1;
+	for (int i = 0; i < PERF_EVENTS; i++)
+		p->fd[i] = -1;
+#ifdef __linux__
+	for (int i = 0; i < PERF_EVENTS; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.disabled = p->leader < 0; // the group starts and stops with its leader
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+			PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		p->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, p->leader, 0);
+		if (p->fd[i] < 0)
+			continue;
+		if (ioctl(p->fd[i], PERF_EVENT_IOC_ID, &p->id[i])) {
+			close(p->fd[i]);
+			p->fd[i] = -1;
+			continue;
+		}
+		if (p->leader < 0)
+			p->leader = p->fd[i];
+	}
+#endif
+	return p->leader < 0;
+}
+
+void
+perf_start(struct Perf *p) {
+#ifdef __linux__
+	if (p->leader >= 0)
+		ioctl(p->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+	(void)p;
+#endif
+}
+
+void
+perf_stop(struct Perf *p) {
+#ifdef __linux__
+	if (p->leader >= 0)
+		ioctl(p->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#else
+	(void)p;
+#endif
+}
+
+// totals so far, scaled up if the group had to share the pmu. nonzero if there are none
+int
+perf_read(struct Perf *p, struct PerfCount *c) {
+	memset(c, 0, sizeof(*c));
+#ifdef __linux__
+	struct GroupRead g;
+	if (p->leader < 0 || read(p->leader, &g, sizeof(g)) < (ssize_t)(3 * sizeof(uint64_t)))
+		return 1;
+
+	double scale = g.running && g.running < g.enabled ? (double)g.enabled / g.running : 1;
+	for (uint64_t k = 0; k < g.nr && k < PERF_EVENTS; k++) {
+		for (int i = 0; i < PERF_EVENTS; i++) {
+			if (p->fd[i] >= 0 && p->id[i] == g.values[k].id) {
+				c->value[i] = g.values[k].value * scale;
+				c->have |= 1u << i;
+			}
+		}
+	}
+	return c->have == 0;
+#else
+	(void)p;
+	return 1;
+#endif
+}
+
+void
+perf_close(struct Perf *p) {
+	for (int i = 0; i < PERF_EVENTS; i++) {
+		if (p->fd[i] >= 0)
+			close(p->fd[i]);
+		p->fd[i] = -1;
+	}
+	p->leader = -1;
+}
@@ -0,0 +1,35 @@
+#include <stdint.h>
+
+enum PERF_EVENT {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_EVENTS,
+};
+
+extern const char *perf_names[PERF_EVENTS];
+
+/*
+ * hardware counters for this thread through perf_event_open, user space
+ * only, in one group so they count over exactly the same stretches.
+ * events the cpu, kernel or vm doesn't offer are left out.
+ */
+struct Perf {
+	int leader; // -1 when nothing could be opened
+	int fd[PERF_EVENTS];
+	uint64_t id[PERF_EVENTS];
+};
+
+// counts between perf_start() and perf_stop() calls, have is a bit per event
+struct PerfCount {
+	uint64_t value[PERF_EVENTS];
+	unsigned have;
+};
+
+int perf_open(struct Perf *p);
+void perf_start(struct Perf *p);
+void perf_stop(struct Perf *p);
+int perf_read(struct Perf *p, struct PerfCount *c);
+void perf_close(struct Perf *p);
@@ -0,0 +1,83 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "present.h"
+
+// a width x height texture in a window_width x window_height window, nonzero on failure
+int
+present_open(struct Presenter *p, const char *title, int width, int height, int window_width, int window_height) {
+	memset(p, 0, sizeof(*p));
+	p->width = width;
+	p->height = height;
+
+	p->win = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+		window_width, window_height, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+	if (p->win == NULL) {
+		fprintf(stderr, "unable to create sdl win: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	// nearest neighbour keeps the pixels square, the filters do any smoothing
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+	p->renderer = SDL_CreateRenderer(p->win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (p->renderer == NULL) {
+		p->renderer = SDL_CreateRenderer(p->win, -1, SDL_RENDERER_SOFTWARE);
+		p->software = 1;
+	}
+	if (p->renderer == NULL) {
+		fprintf(stderr, "unable to create sdl renderer: %s\n", SDL_GetError());
+		present_close(p);
+		return 1;
+	}
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(p->renderer, &info) == 0)
+		p->vsync = (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+
+	// letterboxed to the cabinet's shape however the window is resized
+	SDL_RenderSetLogicalSize(p->renderer, window_width, window_height);
+
+	// RGB888 is 0x00rrggbb in a uint32_t, what the filters write
+	p->texture = SDL_CreateTexture(p->renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, width, height);
+	if (p->texture == NULL) {
+		fprintf(stderr, "unable to create sdl texture: %s\n", SDL_GetError());
+		present_close(p);
+		return 1;
+	}
+	return 0;
+}
+
+// the texture's pixels to draw the next frame into, pitch in pixels
+uint32_t *
+present_lock(struct Presenter *p, int *pitch) {
+	void *pixels;
+	int bytes;
+
+	if (SDL_LockTexture(p->texture, NULL, &pixels, &bytes))
+		return NULL;
+	*pitch = bytes / sizeof(uint32_t);
+	return pixels;
+}
+
+// unlocks and shows the frame, waiting for vblank when the renderer syncs
+void
+present_frame(struct Presenter *p) {
+	SDL_UnlockTexture(p->texture);
+	SDL_RenderClear(p->renderer);
+	SDL_RenderCopy(p->renderer, p->texture, NULL, NULL);
+	SDL_RenderPresent(p->renderer);
+}
+
+void
+present_close(struct Presenter *p) {
+	if (p->texture)
+		SDL_DestroyTexture(p->texture);
+	if (p->renderer)
+		SDL_DestroyRenderer(p->renderer);
+	if (p->win)
+		SDL_DestroyWindow(p->win);
+	p->texture = NULL;
+	p->renderer = NULL;
+	p->win = NULL;
+}
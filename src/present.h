@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+/*
+ * the frame goes up as a streaming texture no bigger than the filters
+ * make it, and the renderer scales it to the window. without a gpu SDL's
+ * software renderer does the same job.
+ */
+struct Presenter {
+	SDL_Window *win;
+	SDL_Renderer *renderer;
+	SDL_Texture *texture;
+	int width; // of the texture
+	int height;
+	int software;
+	int vsync;
+};
+
+int present_open(struct Presenter *p, const char *title, int width, int height, int window_width, int window_height);
+uint32_t *present_lock(struct Presenter *p, int *pitch);
+void present_frame(struct Presenter *p);
+void present_close(struct Presenter *p);
@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "dissasemble.h"
+#include "profile.h"
+
+struct Profile profile;
+
+void
+profile_reset(void) {
+	memset(&profile, 0, sizeof(profile));
+}
+
+void
+profile_collect(uint8_t *ram) {
+	memset(profile.op_count, 0, sizeof(profile.op_count));
+	memset(profile.op_cycles, 0, sizeof(profile.op_cycles));
+
+	// ram is a cabinet's, MEMORY_SIZE bytes and not the whole address space
+	for (int pc = 0; pc < MEMORY_SIZE; pc++) {
+		if (profile.pc_count[pc] == 0)
+			continue;
+		uint8_t op = ram[pc];
+		profile.pc_cycles[pc] = profile.pc_count[pc] * cycles8080[op];
+		profile.op_count[op] += profile.pc_count[pc];
+		profile.op_cycles[op] += profile.pc_cycles[pc];
+	}
+}
+
+static const uint64_t *sort_key;
+
+static int
+by_key(const void *x, const void *y) {
+	uint64_t a = sort_key[*(const uint32_t *)x];
+	uint64_t b = sort_key[*(const uint32_t *)y];
+	return a < b ? 1 : a > b ? -1 : 0;
+}
+
+// the top opcodes and pcs by emulated cycles, pcs disassembled from ram
+void
+profile_report(uint8_t *ram, int top) {
+	static uint32_t order[0x10000];
+	uint64_t count = 0;
+	uint64_t cycles = 0;
+
+	profile_collect(ram);
+	for (int i = 0; i < 256; i++) {
+		count += profile.op_count[i];
+		cycles += profile.op_cycles[i];
+	}
+	if (count == 0)
+		return;
+
+	printf("%llu instructions, %llu cycles\n", (unsigned long long)count, (unsigned long long)cycles);
+	printf("\nopcode      count     cycles  cycles%%\n");
+	for (int i = 0; i < 256; i++)
+		order[i] = i;
+	sort_key = profile.op_cycles;
+	qsort(order, 256, sizeof(order[0]), by_key);
+	for (int i = 0; i < top && profile.op_cycles[order[i]]; i++) {
+		uint32_t op = order[i];
+		printf("    %02x %10llu %10llu %7.2f%%\n", op,
+			(unsigned long long)profile.op_count[op],
+			(unsigned long long)profile.op_cycles[op],
+			100.0 * profile.op_cycles[op] / cycles);
+	}
+
+	printf("\n     count     cycles  cycles%%  disassembly\n");
+	for (int i = 0; i < 0x10000; i++)
+		order[i] = i;
+	sort_key = profile.pc_cycles;
+	qsort(order, 0x10000, sizeof(order[0]), by_key);
+	for (int i = 0; i < top && profile.pc_cycles[order[i]]; i++) {
+		uint32_t pc = order[i];
+		char line[DISASM_MAX];
+		disassemble_line(&ram[pc], pc, line);
+		printf("%10llu %10llu %7.2f%%  %s\n",
+			(unsigned long long)profile.pc_count[pc],
+			(unsigned long long)profile.pc_cycles[pc],
+			100.0 * profile.pc_cycles[pc] / cycles, line);
+	}
+}
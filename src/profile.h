@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+/*
+ * emulate_profiled() counts executions per pc, the only work on
+ * the hot path. opcode and cycle totals are derived from the code in
+ * memory by profile_collect(), which assumes it was not modified.
+ */
+struct Profile {
+	uint64_t pc_count[0x10000];
+	uint64_t pc_cycles[0x10000];
+	uint64_t op_count[256];
+	uint64_t op_cycles[256];
+};
+
+extern struct Profile profile;
+
+void profile_reset(void);
+void profile_collect(uint8_t *ram);
+void profile_report(uint8_t *ram, int top);
@@ -0,0 +1,28 @@
+// work ram and video ram locations used by the space invaders rom
+enum RAM {
+	REF_ALIEN_Y = 0x2009, // reference alien, the bottom left of the rack
+	REF_ALIEN_X = 0x200a,
+	RACK_DIRECTION = 0x200d, // 0 moving right, 1 moving left
+	PLAYER_ALIVE = 0x2015, // ff while the player's ship is alive
+	PLAYER_X = 0x201b,
+	PLAYER_SHOT = 0x2025, // status, followed by y and x at +4 and +5
+	ROLLING_SHOT = 0x2035, // status, y and x at +8 and +9
+	PLUNGER_SHOT = 0x2045,
+	SQUIGGLY_SHOT = 0x2055,
+	PLAYER_DATA = 0x2067, // msb of the current player's data, 21 or 22
+	NUM_ALIENS = 0x2082,
+	SAUCER_ACTIVE = 0x2084,
+	NUM_COINS = 0x20eb, // credits, bcd
+	GAME_MODE = 0x20ef, // 1 while a game is running, 0 in attract mode
+	HI_SCORE = 0x20f4, // bcd, low byte first
+	P1_SCORE = 0x20f8,
+	P2_SCORE = 0x20fa,
+	P1_RACK = 0x2100, // 55 aliens, 1 while alive
+	P1_SHIPS = 0x21ff, // ships left after the current one
+	P2_RACK = 0x2200,
+	P2_SHIPS = 0x22ff,
+	VRAM = 0x2400,
+};
+
+#define VRAM_SIZE (0x4000 - VRAM)
+#define ALIENS 55
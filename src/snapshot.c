@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "machine.h"
+#include "snapshot.h"
+
+static const char MAGIC[8] = "SIVSNAP2"; // 2 since the aux carry and DAA fixes
+
+// 64 bit fnv-1a
+uint64_t
+rom_hash(const uint8_t *rom, size_t len) {
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= rom[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+/*
+ * $XDG_CACHE_HOME/invaders/<rom hash>-v<core version>-<name>, falling back
+ * to ~/.cache. what an older core left behind is never picked up. creates
+ * the directory on the way.
+ */
+int
+cache_path(char *path, size_t len, uint64_t rom, const char *name) {
+	char dir[512];
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+
+	if (xdg && *xdg)
+		snprintf(dir, sizeof(dir), "%s/invaders", xdg);
+	else if (home && *home)
+		snprintf(dir, sizeof(dir), "%s/.cache/invaders", home);
+	else
+		return 1;
+
+	for (char *p = dir + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		mkdir(dir, 0755);
+		*p = '/';
+	}
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		perror(dir);
+		return 1;
+	}
+
+	snprintf(path, len, "%s/%016llx-v%d-%s", dir, (unsigned long long)rom, CORE_VERSION, name);
+	return 0;
+}
+
+void
+snapshot_take(struct Snapshot *snap, struct Machine *machine) {
+	snap->cpu = *machine->cpu;
+	memcpy(snap->iports, machine->iports, sizeof(snap->iports));
+	memcpy(snap->oports, machine->oports, sizeof(snap->oports));
+	snap->shift = machine->shift;
+	snap->offset = machine->offset;
+	memcpy(snap->ram, machine->cpu->ram, MEMORY_SIZE);
+}
+
+void
+snapshot_restore(const struct Snapshot *snap, struct Machine *machine) {
+	struct CPU *cpu = machine->cpu;
+	struct CPU regs = snap->cpu;
+
+	regs.ram = cpu->ram;
+	memcpy(regs.iports, cpu->iports, sizeof(regs.iports));
+	memcpy(regs.oports, cpu->oports, sizeof(regs.oports));
+	*cpu = regs;
+
+	memcpy(machine->iports, snap->iports, sizeof(snap->iports));
+	memcpy(machine->oports, snap->oports, sizeof(snap->oports));
+	machine->shift = snap->shift;
+	machine->offset = snap->offset;
+	memcpy(cpu->ram, snap->ram, MEMORY_SIZE);
+}
+
+/*
+ * host byte order, the cache is only meant for the machine that wrote it.
+ * registers are stored one by one since struct CPU holds pointers. the
+ * file is written aside and renamed so concurrent runs never see half.
+ */
+int
+snapshot_save(const struct Snapshot *snap, const char *path) {
+	const struct CPU *cpu = &snap->cpu;
+	uint64_t rom = rom_hash(snap->ram, 0x2000);
+	uint8_t regs[] = {
+		cpu->a, cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l,
+		cpu->flags.s, cpu->flags.z, cpu->flags.a, cpu->flags.p, cpu->flags.c,
+		cpu->interrupts, cpu->shift_written,
+	};
+
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+	FILE *f = fopen(tmp, "wb");
+	if (f == NULL) {
+		perror(tmp);
+		return 1;
+	}
+
+	fwrite(MAGIC, 1, sizeof(MAGIC), f);
+	fwrite(&rom, sizeof(rom), 1, f);
+	fwrite(regs, 1, sizeof(regs), f);
+	fwrite(&cpu->sp, sizeof(cpu->sp), 1, f);
+	fwrite(&cpu->pc, sizeof(cpu->pc), 1, f);
+	fwrite(snap->iports, 1, sizeof(snap->iports), f);
+	fwrite(snap->oports, 1, sizeof(snap->oports), f);
+	fwrite(&snap->shift, sizeof(snap->shift), 1, f);
+	fwrite(&snap->offset, sizeof(snap->offset), 1, f);
+	fwrite(snap->ram, 1, MEMORY_SIZE, f);
+
+	if (fclose(f) || rename(tmp, path)) {
+		perror(path);
+		remove(tmp);
+		return 1;
+	}
+	return 0;
+}
+
+int
+snapshot_load(struct Snapshot *snap, const char *path) {
+	struct CPU *cpu = &snap->cpu;
+	char magic[sizeof(MAGIC)];
+	uint8_t regs[14];
+	size_t ok = 0;
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return 1;
+
+	memset(snap, 0, sizeof(*snap));
+	ok += fread(magic, sizeof(magic), 1, f);
+	ok += fread(&snap->rom, sizeof(snap->rom), 1, f);
+	ok += fread(regs, sizeof(regs), 1, f);
+	ok += fread(&cpu->sp, sizeof(cpu->sp), 1, f);
+	ok += fread(&cpu->pc, sizeof(cpu->pc), 1, f);
+	ok += fread(snap->iports, sizeof(snap->iports), 1, f);
+	ok += fread(snap->oports, sizeof(snap->oports), 1, f);
+	ok += fread(&snap->shift, sizeof(snap->shift), 1, f);
+	ok += fread(&snap->offset, sizeof(snap->offset), 1, f);
+	ok += fread(snap->ram, MEMORY_SIZE, 1, f);
+	fclose(f);
+
+	if (ok != 10 || memcmp(magic, MAGIC, sizeof(MAGIC))) {
+		fprintf(stderr, "%s: not a snapshot\n", path);
+		return 1;
+	}
+
+	cpu->a = regs[0];
+	cpu->b = regs[1];
+	cpu->c = regs[2];
+	cpu->d = regs[3];
+	cpu->e = regs[4];
+	cpu->h = regs[5];
+	cpu->l = regs[6];
+	cpu->flags.s = regs[7];
+	cpu->flags.z = regs[8];
+	cpu->flags.a = regs[9];
+	cpu->flags.p = regs[10];
+	cpu->flags.c = regs[11];
+	cpu->interrupts = regs[12];
+	cpu->shift_written = regs[13];
+	return 0;
+}
@@ -0,0 +1,21 @@
+#include <stddef.h>
+#include <stdint.h>
+
+// a whole cabinet: registers, ports and memory
+struct Snapshot {
+	uint64_t rom; // rom_hash() of the rom, filled in by snapshot_load()
+	struct CPU cpu; // registers only, pointers are kept from the target
+	uint8_t iports[4];
+	uint8_t oports[7];
+	uint16_t shift;
+	uint8_t offset;
+	uint8_t ram[MEMORY_SIZE];
+};
+
+uint64_t rom_hash(const uint8_t *rom, size_t len);
+int cache_path(char *path, size_t len, uint64_t rom, const char *name);
+
+void snapshot_take(struct Snapshot *snap, struct Machine *machine);
+void snapshot_restore(const struct Snapshot *snap, struct Machine *machine);
+int snapshot_save(const struct Snapshot *snap, const char *path);
+int snapshot_load(struct Snapshot *snap, const char *path);
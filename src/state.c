@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "machine.h"
+#include "state.h"
+
+// pages are recycled rather than freed, cloning is not thread safe
+static struct Page *free_pages;
+
+static void *
+alloc(size_t size) {
+	void *p = malloc(size);
+	if (p == NULL) {
+		perror("state");
+		exit(1);
+	}
+	return p;
+}
+
+static struct Page *
+page_new(const uint8_t *data) {
+	struct Page *page = free_pages;
+
+	if (page)
+		free_pages = page->next;
+	else
+		page = alloc(sizeof(*page));
+
+	page->refs = 1;
+	memcpy(page->data, data, PAGE_SIZE);
+	return page;
+}
+
+static void
+page_unref(struct Page *page) {
+	if (--page->refs == 0) {
+		page->next = free_pages;
+		free_pages = page;
+	}
+}
+
+static struct Table *
+table_ref(struct Table *table) {
+	table->refs++;
+	return table;
+}
+
+static void
+table_unref(struct Table *table) {
+	if (--table->refs)
+		return;
+	for (int i = 0; i < PAGES; i++)
+		page_unref(table->pages[i]);
+	free(table);
+}
+
+static int
+dirty(const struct CPU *cpu, int page) {
+	return (cpu->dirty[page >> 5] >> (page & 31)) & 1;
+}
+
+static int
+any_dirty(const struct CPU *cpu) {
+	uint32_t bits = 0;
+	for (int i = 0; i < 8; i++)
+		bits |= cpu->dirty[i];
+	return bits != 0;
+}
+
+/*
+ * starts with every page of the machine's memory private to the workspace.
+ * the machine runs emulate_dirty() from here on, the variant that marks
+ * the pages a capture or load has to look at.
+ */
+void
+workspace_init(struct Workspace *ws, struct Machine *machine) {
+	ws->machine = machine;
+	machine->emulate = emulate_dirty;
+	ws->table = alloc(sizeof(*ws->table));
+	ws->table->refs = 1;
+	for (int i = 0; i < PAGES; i++)
+		ws->table->pages[i] = page_new(&machine->cpu->ram[i * PAGE_SIZE]);
+	memset(machine->cpu->dirty, 0, sizeof(machine->cpu->dirty));
+}
+
+void
+workspace_free(struct Workspace *ws) {
+	table_unref(ws->table);
+}
+
+/*
+ * a new state from the workspace's machine. only pages written since the
+ * last load or capture are copied, everything else is shared.
+ */
+struct State *
+state_capture(struct Workspace *ws) {
+	struct CPU *cpu = ws->machine->cpu;
+	struct State *state = alloc(sizeof(*state));
+
+	state->cpu = *cpu;
+	memcpy(state->iports, ws->machine->iports, sizeof(state->iports));
+	memcpy(state->oports, ws->machine->oports, sizeof(state->oports));
+	state->shift = ws->machine->shift;
+	state->offset = ws->machine->offset;
+
+	if (any_dirty(cpu)) {
+		struct Table *table = alloc(sizeof(*table));
+		table->refs = 1;
+		for (int i = 0; i < PAGES; i++) {
+			if (dirty(cpu, i)) {
+				table->pages[i] = page_new(&cpu->ram[i * PAGE_SIZE]);
+			} else {
+				table->pages[i] = ws->table->pages[i];
+				table->pages[i]->refs++;
+			}
+		}
+		table_unref(ws->table);
+		ws->table = table;
+		memset(cpu->dirty, 0, sizeof(cpu->dirty));
+	}
+
+	state->table = table_ref(ws->table);
+	return state;
+}
+
+struct State *
+state_clone(const struct State *state) {
+	struct State *clone = alloc(sizeof(*clone));
+
+	*clone = *state;
+	table_ref(clone->table);
+	return clone;
+}
+
+/*
+ * makes the workspace's machine run from state. pages the machine already
+ * holds unchanged are left alone, so moving between related states only
+ * copies the pages where they differ.
+ */
+void
+state_load(struct Workspace *ws, const struct State *state) {
+	struct Machine *machine = ws->machine;
+	struct CPU *cpu = machine->cpu;
+	struct CPU regs = state->cpu;
+
+	if (ws->table != state->table || any_dirty(cpu)) {
+		for (int i = 0; i < PAGES; i++) {
+			struct Page *page = state->table->pages[i];
+			if (ws->table->pages[i] != page || dirty(cpu, i))
+				memcpy(&cpu->ram[i * PAGE_SIZE], page->data, PAGE_SIZE);
+		}
+		table_unref(ws->table);
+		ws->table = table_ref(state->table);
+	}
+
+	regs.ram = cpu->ram;
+	memcpy(regs.iports, cpu->iports, sizeof(regs.iports));
+	memcpy(regs.oports, cpu->oports, sizeof(regs.oports));
+	memset(regs.dirty, 0, sizeof(regs.dirty));
+	*cpu = regs;
+
+	memcpy(machine->iports, state->iports, sizeof(state->iports));
+	memcpy(machine->oports, state->oports, sizeof(state->oports));
+	machine->shift = state->shift;
+	machine->offset = state->offset;
+}
+
+void
+state_free(struct State *state) {
+	table_unref(state->table);
+	free(state);
+}
@@ -0,0 +1,43 @@
+#include <stdint.h>
+
+#define PAGE_SIZE 256
+#define PAGES (MEMORY_SIZE / PAGE_SIZE)
+
+struct Page {
+	int refs;
+	struct Page *next; // free list
+	uint8_t data[PAGE_SIZE];
+};
+
+// a whole memory as reference counted pages, itself shared between clones
+struct Table {
+	int refs;
+	struct Page *pages[PAGES];
+};
+
+/*
+ * a cabinet state. its memory shares every page with the states it was
+ * cloned from or into until the page is written.
+ */
+struct State {
+	struct CPU cpu; // registers only, like struct Snapshot
+	uint8_t iports[4];
+	uint8_t oports[7];
+	uint16_t shift;
+	uint8_t offset;
+	struct Table *table;
+};
+
+// the machine states are run in, and the table its memory currently holds
+struct Workspace {
+	struct Machine *machine;
+	struct Table *table;
+};
+
+void workspace_init(struct Workspace *ws, struct Machine *machine);
+void workspace_free(struct Workspace *ws);
+
+struct State *state_capture(struct Workspace *ws);
+struct State *state_clone(const struct State *state);
+void state_load(struct Workspace *ws, const struct State *state);
+void state_free(struct State *state);
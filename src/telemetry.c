@@ -0,0 +1,311 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifndef WEB
+#include <pthread.h>
+#endif
+
+#include "clock.h"
+#include "telemetry.h"
+
+#define FRAME_NS (1000000000 / 60)
+
+// 3x5 glyphs, a bit per pixel from the top left, three bits a row
+static const uint16_t font[128] = {
+	['0'] = 0x7b6f, ['1'] = 0x2c97, ['2'] = 0x73e7, ['3'] = 0x73cf, ['4'] = 0x5bc9, ['5'] = 0x79cf,
+	['6'] = 0x79ef, ['7'] = 0x7249, ['8'] = 0x7bef, ['9'] = 0x7bcf, ['A'] = 0x2bed, ['B'] = 0x6bae,
+	['C'] = 0x3923, ['D'] = 0x6b6e, ['E'] = 0x79a7, ['F'] = 0x79a4, ['G'] = 0x396b, ['H'] = 0x5bed,
+	['I'] = 0x7497, ['J'] = 0x126a, ['K'] = 0x5bad, ['L'] = 0x4927, ['M'] = 0x5fed, ['N'] = 0x6b6d,
+	['O'] = 0x2b6a, ['P'] = 0x6ba4, ['Q'] = 0x2b73, ['R'] = 0x6bad, ['S'] = 0x388e, ['T'] = 0x7492,
+	['U'] = 0x5b6f, ['V'] = 0x5b6a, ['W'] = 0x5bfd, ['X'] = 0x5aad, ['Y'] = 0x5a92, ['Z'] = 0x72a7,
+	['.'] = 0x0002, ['%'] = 0x52a5, [':'] = 0x0410, ['/'] = 0x12a4, ['-'] = 0x01c0,
+};
+
+static void
+connect_socket(struct Telemetry *t) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", t->path + 5);
+
+	t->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (t->sock >= 0 && connect(t->sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(t->sock);
+		t->sock = -1;
+	}
+}
+
+// a line to the file, or the socket if anything is listening, dropped otherwise
+static void
+export(struct Telemetry *t, const char *line, int len) {
+	if (t->f) {
+		fwrite(line, 1, len, t->f);
+		fflush(t->f);
+		return;
+	}
+	if (strncmp(t->path, "unix:", 5))
+		return;
+	if (t->sock < 0)
+		connect_socket(t);
+	if (t->sock >= 0 && send(t->sock, line, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len) {
+		close(t->sock);
+		t->sock = -1;
+	}
+}
+
+// ms below which p of the frames in hist fall
+static double
+percentile(const uint64_t *hist, uint64_t n, double p) {
+	uint64_t want = n * p;
+	uint64_t seen = 0;
+
+	if (n == 0)
+		return 0;
+	for (int b = 0; b < TELEMETRY_BUCKETS; b++) {
+		seen += hist[b];
+		if (seen > want)
+			return (b + 1) * (double)TELEMETRY_BUCKET / 1e6;
+	}
+	return TELEMETRY_BUCKETS * (double)TELEMETRY_BUCKET / 1e6;
+}
+
+// everything since the last sample out as a JSON line and into the overlay's text
+static void
+sample(struct Telemetry *t) {
+	uint64_t now = clock_ns();
+	double secs = (now - t->last_ns) / 1e9;
+	struct TelemetryCounters d = {0};
+	char threads[TELEMETRY_THREADS * 48] = "";
+	int at = 0;
+
+	int nthreads = __atomic_load_n(&t->nthreads, __ATOMIC_ACQUIRE);
+	for (int i = 0; i < nthreads; i++) {
+		const uint64_t *cur = &t->threads[i].instructions;
+		uint64_t *last = &t->last[i].instructions;
+		uint64_t *sum = &d.instructions;
+		uint64_t busy = 0;
+
+		for (int p = 0; p < PHASES; p++)
+			busy += __atomic_load_n(&t->threads[i].ns[p], __ATOMIC_RELAXED) - t->last[i].ns[p];
+		// every counter from instructions up to last_frame is a uint64_t
+		int n = (offsetof(struct TelemetryCounters, last_frame) - offsetof(struct TelemetryCounters, instructions)) / sizeof(uint64_t);
+		for (int k = 0; k < n; k++) {
+			uint64_t v = __atomic_load_n(&cur[k], __ATOMIC_RELAXED);
+			sum[k] += v - last[k];
+			last[k] = v;
+		}
+		at += snprintf(threads + at, sizeof(threads) - at, "%s{\"name\": \"%s\", \"busy_pct\": %.1f}",
+			i ? ", " : "", t->threads[i].name, secs > 0 ? busy / 1e7 / secs : 0.0);
+	}
+	t->last_ns = now;
+	if (secs <= 0)
+		return;
+
+	double pct[PHASES];
+	for (int p = 0; p < PHASES; p++)
+		pct[p] = d.ns[p] / 1e7 / secs;
+	double p50 = percentile(d.hist, d.frames, 0.5);
+	double p90 = percentile(d.hist, d.frames, 0.9);
+	double p99 = percentile(d.hist, d.frames, 0.99);
+	double late = d.interrupts ? (double)d.late / d.interrupts : 0;
+
+	char line[1024];
+	int len = snprintf(line, sizeof(line),
+		"{\"t\": %.3f, \"mhz\": %.3f, \"ips\": %.0f, \"fps\": %.2f, "
+		"\"frame_ms\": {\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f}, "
+		"\"phase_pct\": {\"emulate\": %.1f, \"draw\": %.1f, \"present\": %.1f, \"input\": %.1f}, "
+		"\"dropped\": %llu, \"interrupts\": %llu, \"late_cycles\": %.1f, \"underruns\": %llu, \"threads\": [%s]}\n",
+		(now - t->start_ns) / 1e9, d.cycles / 1e6 / secs, d.instructions / secs, d.frames / secs,
+		p50, p90, p99, pct[PHASE_EMULATE], pct[PHASE_DRAW], pct[PHASE_PRESENT], pct[PHASE_INPUT],
+		(unsigned long long)d.dropped, (unsigned long long)d.interrupts, late,
+		(unsigned long long)d.underruns, threads);
+	if (len >= (int)sizeof(line))
+		len = sizeof(line) - 1;
+	export(t, line, len);
+
+	// the text is written between two bumps of seq, see telemetry_text()
+	unsigned seq = t->seq;
+	__atomic_store_n(&t->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	snprintf(t->text, sizeof(t->text),
+		"MHZ %.2f MIPS %.2f FPS %.1f\n"
+		"FRAME MS P50 %.2f P90 %.2f P99 %.2f\n"
+		"EMU %.0f%% DRAW %.0f%% PRESENT %.0f%% INPUT %.0f%%\n"
+		"DROPPED %llu LATE %.0f CY UNDERRUNS %llu",
+		d.cycles / 1e6 / secs, d.instructions / 1e6 / secs, d.frames / secs,
+		p50, p90, p99, pct[PHASE_EMULATE], pct[PHASE_DRAW], pct[PHASE_PRESENT], pct[PHASE_INPUT],
+		(unsigned long long)d.dropped, late, (unsigned long long)d.underruns);
+	__atomic_store_n(&t->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+#ifndef WEB
+static void *
+sampler(void *arg) {
+	struct Telemetry *t = arg;
+	struct timespec nap = { 0, 10000000 };
+
+	while (!__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+		nanosleep(&nap, NULL);
+		if (clock_ns() - t->last_ns >= (uint64_t)t->interval * 1000000)
+			sample(t);
+	}
+	return NULL;
+}
+#endif
+
+/*
+ * samples every interval ms, exporting to path if it is given: a file
+ * appended to, or unix:/path for a listening stream socket.
+ */
+struct Telemetry *
+telemetry_open(const char *path, int interval) {
+	struct Telemetry *t;
+	if (posix_memalign((void **)&t, 64, sizeof(*t)))
+		return NULL;
+	memset(t, 0, sizeof(*t));
+	t->interval = interval > 0 ? interval : 1000;
+	t->sock = -1;
+	t->start_ns = t->last_ns = clock_ns();
+
+	if (path) {
+		snprintf(t->path, sizeof(t->path), "%s", path);
+		if (strncmp(path, "unix:", 5) && (t->f = fopen(path, "a")) == NULL) {
+			perror(path);
+			free(t);
+			return NULL;
+		}
+	}
+#ifndef WEB
+	if (pthread_create(&t->sampler, NULL, sampler, t)) {
+		if (t->f)
+			fclose(t->f);
+		free(t);
+		return NULL;
+	}
+#endif
+	return t;
+}
+
+// stops the sampler after a last sample
+void
+telemetry_close(struct Telemetry *t) {
+	if (t == NULL)
+		return;
+#ifndef WEB
+	__atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(t->sampler, NULL);
+#endif
+	sample(t);
+	if (t->f)
+		fclose(t->f);
+	if (t->sock >= 0)
+		close(t->sock);
+	free(t);
+}
+
+// counters for the calling thread, NULL when all TELEMETRY_THREADS are taken
+struct TelemetryCounters *
+telemetry_thread(struct Telemetry *t, const char *name) {
+	int i = __atomic_load_n(&t->nthreads, __ATOMIC_RELAXED);
+	if (i == TELEMETRY_THREADS)
+		return NULL;
+	snprintf(t->threads[i].name, sizeof(t->threads[i].name), "%s", name);
+	__atomic_store_n(&t->nthreads, i + 1, __ATOMIC_RELEASE);
+	return &t->threads[i];
+}
+
+// a frame presented at now, late ones counted as the frames they cover
+void
+telemetry_frame(struct TelemetryCounters *c, uint64_t now) {
+	if (c->last_frame) {
+		uint64_t took = now - c->last_frame;
+		int b = took / TELEMETRY_BUCKET;
+		if (b >= TELEMETRY_BUCKETS)
+			b = TELEMETRY_BUCKETS - 1;
+		TELEMETRY_ADD(c->hist[b], 1);
+		if (took > FRAME_NS * 3 / 2)
+			TELEMETRY_ADD(c->dropped, (took + FRAME_NS / 2) / FRAME_NS - 1);
+	}
+	TELEMETRY_ADD(c->frames, 1);
+	c->last_frame = now;
+}
+
+// an interrupt raised late cycles after it was due
+void
+telemetry_interrupt(struct TelemetryCounters *c, uint64_t late) {
+	TELEMETRY_ADD(c->interrupts, 1);
+	TELEMETRY_ADD(c->late, late);
+}
+
+// without threads the emulation loop calls this to take the samples
+void
+telemetry_poll(struct Telemetry *t) {
+#ifdef WEB
+	if (clock_ns() - t->last_ns >= (uint64_t)t->interval * 1000000)
+		sample(t);
+#else
+	(void)t;
+#endif
+}
+
+// copies the last sample's summary into text, leaving it alone if the sampler is mid write
+int
+telemetry_text(struct Telemetry *t, char *text) {
+	char copy[TELEMETRY_TEXT];
+	unsigned seq = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+	if (seq & 1)
+		return 1;
+	memcpy(copy, t->text, sizeof(copy));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&t->seq, __ATOMIC_RELAXED) != seq)
+		return 1;
+	copy[TELEMETRY_TEXT - 1] = '\0';
+	memcpy(text, copy, sizeof(copy));
+	return 0;
+}
+
+// text over a darkened box in the top left of a width x height frame, glyphs scale pixels a dot
+void
+telemetry_draw(const char *text, uint32_t *pixels, int pitch, int width, int height, int scale) {
+	int x = scale;
+	int y = scale;
+	int lines = 1;
+	int cols = 0;
+
+	for (int i = 0, col = 0; text[i]; i++) {
+		col = text[i] == '\n' ? 0 : col + 1;
+		lines += text[i] == '\n';
+		cols = col > cols ? col : cols;
+	}
+	int w = (cols * 4 + 1) * scale;
+	int h = (lines * 6 + 1) * scale;
+	for (int py = 0; py < h && py < height; py++) {
+		for (int px = 0; px < w && px < width; px++)
+			pixels[py * pitch + px] = pixels[py * pitch + px] >> 2 & 0x3f3f3f;
+	}
+
+	for (; *text; text++) {
+		if (*text == '\n') {
+			x = scale;
+			y += 6 * scale;
+			continue;
+		}
+		int c = *text >= 'a' && *text <= 'z' ? *text - 'a' + 'A' : *text & 0x7f;
+		for (int bit = 0; bit < 15; bit++) {
+			if (!(font[c] >> (14 - bit) & 1))
+				continue;
+			int gx = x + bit % 3 * scale;
+			int gy = y + bit / 3 * scale;
+			for (int sy = gy; sy < gy + scale && sy < height; sy++) {
+				for (int sx = gx; sx < gx + scale && sx < width; sx++)
+					pixels[sy * pitch + sx] = 0xffffff;
+			}
+		}
+		x += 4 * scale;
+	}
+}
@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include <stdio.h>
+#ifndef WEB
+#include <pthread.h>
+#endif
+
+#define TELEMETRY_THREADS 8
+#define TELEMETRY_BUCKET 250000 // ns of frame time per histogram bucket
+#define TELEMETRY_BUCKETS 200 // the last one holds everything from 50 ms up
+#define TELEMETRY_TEXT 256
+
+enum TELEMETRY_PHASE {
+	PHASE_EMULATE, // the cpu, shift register and sound mixing
+	PHASE_DRAW, // filters and the overlay
+	PHASE_PRESENT, // up to the screen, vsync included
+	PHASE_INPUT,
+	PHASES,
+};
+
+/*
+ * a thread's counters. only the thread that registered them writes them,
+ * with relaxed stores the sampler can read at any time, so nothing on
+ * the emulation side takes a lock or a locked instruction.
+ */
+struct TelemetryCounters {
+	char name[16];
+	uint64_t instructions;
+	uint64_t cycles; // emulated
+	uint64_t frames; // presented
+	uint64_t dropped; // frames a slow present or a stall skipped
+	uint64_t interrupts;
+	uint64_t late; // cycles past the half frame mark, summed over interrupts
+	uint64_t underruns; // host audio samples missed
+	uint64_t ns[PHASES];
+	uint64_t hist[TELEMETRY_BUCKETS]; // frame times
+	uint64_t last_frame; // clock_ns() of the last present, the owner's alone
+} __attribute__((aligned(64)));
+
+/*
+ * a sampler thread sums the counters every interval, writes a JSON line
+ * of rates and frame time percentiles to a file or unix socket, and
+ * leaves a summary for the overlay behind a sequence count.
+ */
+struct Telemetry {
+	struct TelemetryCounters threads[TELEMETRY_THREADS];
+	int nthreads;
+
+	struct TelemetryCounters last[TELEMETRY_THREADS]; // as they were at the previous sample
+	uint64_t last_ns;
+	uint64_t start_ns;
+	int interval; // ms
+	char path[1024];
+	FILE *f;
+	int sock; // -1 unless path is unix:...
+
+	unsigned seq; // odd while text is being written
+	char text[TELEMETRY_TEXT];
+
+	int stop;
+#ifndef WEB
+	pthread_t sampler;
+#endif
+};
+
+// owner only: counter += n where the sampler can see it
+#define TELEMETRY_ADD(counter, n) __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+
+struct Telemetry *telemetry_open(const char *path, int interval);
+void telemetry_close(struct Telemetry *t);
+struct TelemetryCounters *telemetry_thread(struct Telemetry *t, const char *name);
+void telemetry_frame(struct TelemetryCounters *c, uint64_t now);
+void telemetry_interrupt(struct TelemetryCounters *c, uint64_t late);
+void telemetry_poll(struct Telemetry *t);
+int telemetry_text(struct Telemetry *t, char *text);
+void telemetry_draw(const char *text, uint32_t *pixels, int pitch, int width, int height, int scale);
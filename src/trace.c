@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "trace.h"
+#include "dissasemble.h"
+
+static const char MAGIC[8] = "SIVTRAC1";
+static struct Tracer *active; // the one trace_hook records into
+
+void
+trace_record(struct Tracer *t, struct CPU *cpu, uint16_t pc, int took) {
+	uint64_t head = t->head;
+	while (head - __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE) == TRACE_RING)
+		sched_yield(); // full, a trace is no use with holes in it
+
+	struct Record *r = &t->ring[head & (TRACE_RING - 1)];
+	r->cycles = t->cycles;
+	r->pc = pc;
+	r->next = cpu->pc;
+	r->sp = cpu->sp;
+	r->op[0] = cpu->ram[pc];
+	r->op[1] = cpu->ram[pc + 1];
+	r->op[2] = cpu->ram[pc + 2];
+	r->next_op = cpu->ram[cpu->pc];
+	r->a = cpu->a;
+	r->psw = get_psw(&cpu->flags);
+	r->b = cpu->b;
+	r->c = cpu->c;
+	r->d = cpu->d;
+	r->e = cpu->e;
+	r->h = cpu->h;
+	r->l = cpu->l;
+	r->m = cpu->ram[cpu->h << 8 | cpu->l];
+	r->stack[0] = cpu->ram[cpu->sp];
+	r->stack[1] = cpu->ram[cpu->sp + 1];
+	r->took = took;
+	r->interrupts = cpu->interrupts;
+	r->pad = 0;
+	t->cycles += took;
+
+	__atomic_store_n(&t->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void
+record(struct CPU *cpu, uint16_t pc, int cycles) {
+	trace_record(active, cpu, pc, cycles);
+}
+
+/*
+ * each record is stored as a 32 bit mask of the bytes that differ from
+ * the previous one followed by those bytes xored with it. consecutive
+ * instructions share most of their state, so a record is 6-10 bytes.
+ */
+static void
+write_record(struct Tracer *t, const struct Record *rec) {
+	const uint8_t *cur = (const uint8_t *)rec;
+	const uint8_t *last = (const uint8_t *)&t->last;
+	uint8_t out[4 + sizeof(*rec)];
+	uint32_t mask = 0;
+	int n = 4;
+
+	for (size_t i = 0; i < sizeof(*rec); i++) {
+		uint8_t x = cur[i] ^ last[i];
+		if (x) {
+			mask |= 1u << i;
+			out[n++] = x;
+		}
+	}
+	memcpy(out, &mask, sizeof(mask));
+	fwrite(out, 1, n, t->f);
+	t->last = *rec;
+}
+
+static void *
+drain(void *arg) {
+	struct Tracer *t = arg;
+	struct timespec idle = { 0, 100000 };
+
+	for (;;) {
+		// stop is read first so every record before it is in head
+		int stop = __atomic_load_n(&t->stop, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = t->tail;
+
+		if (tail == head) {
+			if (stop)
+				break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+		for (; tail != head; tail++) {
+			write_record(t, &t->ring[tail & (TRACE_RING - 1)]);
+			if ((tail & 4095) == 4095)
+				__atomic_store_n(&t->tail, tail + 1, __ATOMIC_RELEASE);
+		}
+		__atomic_store_n(&t->tail, tail, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+// starts tracing every emulate_traced() call to path
+struct Tracer *
+trace_open(const char *path) {
+	struct Tracer *t = calloc(1, sizeof(*t));
+	if (t == NULL)
+		return NULL;
+
+	t->f = fopen(path, "wb");
+	if (t->f == NULL) {
+		perror(path);
+		free(t);
+		return NULL;
+	}
+	fwrite(MAGIC, 1, sizeof(MAGIC), t->f);
+
+	if (pthread_create(&t->worker, NULL, drain, t)) {
+		fclose(t->f);
+		free(t);
+		return NULL;
+	}
+
+	active = t;
+	trace_hook = record;
+	return t;
+}
+
+// flushes whatever is left in the ring and closes the file
+void
+trace_close(struct Tracer *t) {
+	if (t == NULL)
+		return;
+	if (active == t) {
+		trace_hook = NULL;
+		active = NULL;
+	}
+
+	__atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(t->worker, NULL);
+	fclose(t->f);
+	free(t);
+}
+
+// opens a trace for trace_read(), NULL if path is not one
+FILE *
+trace_reader(const char *path) {
+	char magic[sizeof(MAGIC)];
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		return NULL;
+	}
+
+	if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+			memcmp(magic, MAGIC, sizeof(MAGIC))) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+// the next record into rec, last starts zeroed and is kept by the caller
+int
+trace_read(FILE *f, struct Record *rec, struct Record *last) {
+	uint32_t mask;
+	if (fread(&mask, sizeof(mask), 1, f) != 1)
+		return 1;
+
+	uint8_t *cur = (uint8_t *)rec;
+	*rec = *last;
+	for (size_t i = 0; i < sizeof(*rec); i++) {
+		if (!(mask & 1u << i))
+			continue;
+		int x = fgetc(f);
+		if (x == EOF)
+			return 1;
+		cur[i] ^= x;
+	}
+	*last = *rec;
+	return 0;
+}
+
+// the text print_cpu_state() and get_opname() print for the same step
+void
+trace_print(const struct Record *rec) {
+	char line[DISASM_MAX];
+	disassemble_line(rec->op, rec->pc, line);
+
+	printf("%s\n->%02x cycles: %04d af: %02x%02x bc: %02x%02x de: %02x%02x hl: %02x%02x "
+		"pc: %04x sp: %04x m: %02x %c%c%c%c%c stack: %02x %02x\n",
+		line, rec->next_op, rec->took, rec->a, rec->psw, rec->b, rec->c,
+		rec->d, rec->e, rec->h, rec->l, rec->next, rec->sp, rec->m,
+		rec->psw & ZERO ? 'z' : '-',
+		rec->psw & SIGN ? 's' : '-',
+		rec->psw & PARITY ? 'p' : '-',
+		rec->interrupts ? 'i' : '-',
+		rec->psw & CARRY ? 'c' : '-',
+		rec->stack[0], rec->stack[1]);
+}
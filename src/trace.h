@@ -0,0 +1,46 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define TRACE_RING 65536 // records, a power of two
+
+// one instruction: pc and bytes before it ran, registers after
+struct Record {
+	uint64_t cycles; // total before the instruction
+	uint16_t pc;
+	uint16_t next; // pc after
+	uint16_t sp;
+	uint8_t op[3];
+	uint8_t next_op;
+	uint8_t a, psw, b, c, d, e, h, l;
+	uint8_t m; // (hl)
+	uint8_t stack[2];
+	uint8_t took; // cycles taken
+	uint8_t interrupts;
+	uint8_t pad;
+};
+
+/*
+ * emulate_traced() writes records into the ring through trace_hook, a
+ * worker thread drains it, delta compresses and writes them out. one
+ * producer, one consumer, and one open tracer at a time.
+ */
+struct Tracer {
+	struct Record ring[TRACE_RING];
+	uint64_t head; // written by the producer
+	uint64_t tail; // written by the worker
+	int stop;
+
+	uint64_t cycles;
+	struct Record last; // previous record written, the delta base
+	FILE *f;
+	pthread_t worker;
+};
+
+struct Tracer *trace_open(const char *path);
+void trace_close(struct Tracer *t);
+void trace_record(struct Tracer *t, struct CPU *cpu, uint16_t pc, int took);
+
+FILE *trace_reader(const char *path);
+int trace_read(FILE *f, struct Record *rec, struct Record *last);
+void trace_print(const struct Record *rec);
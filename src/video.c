@@ -0,0 +1,264 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "video.h"
+
+static const char MAGIC[8] = "SIVVID01";
+static const char INDEX[8] = "SIVVIDIX";
+
+// what follows the index: its offset, the frame and key counts, INDEX
+#define TRAILER (8 + 8 + 4 + sizeof(INDEX))
+
+/*
+ * a byte below 0x80 skips that many plus one unchanged bytes, one above
+ * is followed by its low seven bits plus one bytes to xor in. a frame
+ * where only the invaders stepped is a few dozen bytes.
+ */
+size_t
+video_encode(const uint8_t *delta, uint8_t *out) {
+	size_t n = 0;
+	int i = 0;
+
+	while (i < VIDEO_VRAM) {
+		int run = 0;
+		while (i + run < VIDEO_VRAM && delta[i + run] == 0)
+			run++;
+		i += run;
+		for (; run > 0 && i < VIDEO_VRAM; run -= 128)
+			out[n++] = (run > 128 ? 128 : run) - 1;
+		if (i == VIDEO_VRAM)
+			break;
+
+		// literals until two unchanged bytes in a row, a lone one is cheaper kept
+		int len = 0;
+		while (i + len < VIDEO_VRAM && len < 128 &&
+				(delta[i + len] || (i + len + 1 < VIDEO_VRAM && delta[i + len + 1])))
+			len++;
+		out[n++] = 0x80 | (len - 1);
+		memcpy(&out[n], &delta[i], len);
+		n += len;
+		i += len;
+	}
+	return n;
+}
+
+// xors a frame coded by video_encode() into frame, nonzero if it is corrupt
+int
+video_decode(const uint8_t *in, size_t len, uint8_t *frame) {
+	size_t at = 0;
+	int i = 0;
+
+	while (at < len) {
+		uint8_t op = in[at++];
+		int count = (op & 0x7f) + 1;
+		if (i + count > VIDEO_VRAM)
+			return 1;
+		if (op & 0x80) {
+			if (at + count > len)
+				return 1;
+			for (int k = 0; k < count; k++)
+				frame[i + k] ^= in[at + k];
+			at += count;
+		}
+		i += count;
+	}
+	return 0;
+}
+
+struct Video *
+video_open(const char *path) {
+	struct Video *v = calloc(1, sizeof(*v));
+	uint32_t size = VIDEO_VRAM;
+
+	snprintf(v->path, sizeof(v->path), "%s", path);
+	v->f = fopen(path, "wb");
+	if (v->f == NULL) {
+		perror(path);
+		free(v);
+		return NULL;
+	}
+	fwrite(MAGIC, 1, sizeof(MAGIC), v->f);
+	fwrite(&size, sizeof(size), 1, v->f);
+	v->bytes = sizeof(MAGIC) + sizeof(size);
+	return v;
+}
+
+// host byte order like snapshots: the type, the coded length, the coded frame
+int
+video_frame(struct Video *v, const uint8_t *vram) {
+	uint8_t delta[VIDEO_VRAM];
+	uint8_t out[VIDEO_MAX];
+	uint8_t type = v->frames % VIDEO_KEYFRAMES ? VIDEO_DELTA : VIDEO_KEY;
+
+	if (type == VIDEO_KEY) {
+		if (v->nkeys == v->cap) {
+			v->cap = v->cap ? v->cap * 2 : 64;
+			v->keys = realloc(v->keys, v->cap * sizeof(v->keys[0]));
+		}
+		v->keys[v->nkeys++] = (struct VideoKey){ v->frames, v->bytes };
+		memset(v->last, 0, sizeof(v->last));
+	}
+	for (int i = 0; i < VIDEO_VRAM; i++)
+		delta[i] = vram[i] ^ v->last[i];
+	memcpy(v->last, vram, sizeof(v->last));
+
+	uint32_t len = video_encode(delta, out);
+	fwrite(&type, sizeof(type), 1, v->f);
+	fwrite(&len, sizeof(len), 1, v->f);
+	fwrite(out, 1, len, v->f);
+	v->bytes += sizeof(type) + sizeof(len) + len;
+	v->frames++;
+	return ferror(v->f);
+}
+
+// writes the keyframe index and closes, nonzero if anything failed
+int
+video_close(struct Video *v) {
+	if (v == NULL)
+		return 0;
+
+	uint64_t index = v->bytes;
+	fwrite(v->keys, sizeof(v->keys[0]), v->nkeys, v->f);
+	fwrite(&index, sizeof(index), 1, v->f);
+	fwrite(&v->frames, sizeof(v->frames), 1, v->f);
+	fwrite(&v->nkeys, sizeof(v->nkeys), 1, v->f);
+	fwrite(INDEX, 1, sizeof(INDEX), v->f);
+
+	int failed = ferror(v->f) | fclose(v->f);
+	if (failed)
+		perror(v->path);
+	free(v->keys);
+	free(v);
+	return failed;
+}
+
+// a recording cut short has no index, walk its frames for one
+static int
+scan(struct VideoReader *r, uint64_t offset, uint64_t end) {
+	uint32_t cap = 0;
+	uint8_t type;
+	uint32_t len;
+
+	r->nkeys = 0;
+	r->frames = 0;
+	fseek(r->f, offset, SEEK_SET);
+	while (fread(&type, sizeof(type), 1, r->f) && fread(&len, sizeof(len), 1, r->f) &&
+			len <= VIDEO_MAX && offset + sizeof(type) + sizeof(len) + len <= end) {
+		if (type == VIDEO_KEY) {
+			if (r->nkeys == cap) {
+				cap = cap ? cap * 2 : 64;
+				r->keys = realloc(r->keys, cap * sizeof(r->keys[0]));
+			}
+			r->keys[r->nkeys++] = (struct VideoKey){ r->frames, offset };
+		}
+		if (fseek(r->f, len, SEEK_CUR))
+			break;
+		offset += sizeof(type) + sizeof(len) + len;
+		r->frames++;
+	}
+	return r->nkeys == 0 && r->frames > 0;
+}
+
+int
+video_reader_open(struct VideoReader *r, const char *path) {
+	char magic[sizeof(MAGIC)];
+	uint32_t size;
+
+	memset(r, 0, sizeof(*r));
+	r->f = fopen(path, "rb");
+	if (r->f == NULL) {
+		perror(path);
+		return 1;
+	}
+	if (fread(magic, sizeof(magic), 1, r->f) != 1 || fread(&size, sizeof(size), 1, r->f) != 1 ||
+			memcmp(magic, MAGIC, sizeof(MAGIC)) || size != VIDEO_VRAM) {
+		fprintf(stderr, "%s: not a recording\n", path);
+		fclose(r->f);
+		return 1;
+	}
+	uint64_t start = sizeof(MAGIC) + sizeof(size);
+
+	char index[sizeof(INDEX)];
+	uint64_t at = 0;
+	fseek(r->f, 0, SEEK_END);
+	long end = ftell(r->f);
+	int indexed = end >= (long)(start + TRAILER) && fseek(r->f, end - TRAILER, SEEK_SET) == 0 &&
+		fread(&at, sizeof(at), 1, r->f) && fread(&r->frames, sizeof(r->frames), 1, r->f) &&
+		fread(&r->nkeys, sizeof(r->nkeys), 1, r->f) && fread(index, sizeof(index), 1, r->f) &&
+		memcmp(index, INDEX, sizeof(INDEX)) == 0 &&
+		at + (uint64_t)r->nkeys * sizeof(r->keys[0]) + TRAILER == (uint64_t)end;
+
+	if (indexed) {
+		r->keys = malloc((r->nkeys ? r->nkeys : 1) * sizeof(r->keys[0]));
+		fseek(r->f, at, SEEK_SET);
+		indexed = fread(r->keys, sizeof(r->keys[0]), r->nkeys, r->f) == r->nkeys;
+	}
+	if (!indexed && scan(r, start, end)) {
+		fprintf(stderr, "%s: no keyframe\n", path);
+		video_reader_close(r);
+		return 1;
+	}
+	fseek(r->f, start, SEEK_SET);
+	return 0;
+}
+
+// the next frame's video ram, 1 at the end
+int
+video_read(struct VideoReader *r, uint8_t *vram) {
+	uint8_t in[VIDEO_MAX];
+	uint8_t type;
+	uint32_t len;
+
+	if (r->next >= r->frames)
+		return 1;
+	if (fread(&type, sizeof(type), 1, r->f) != 1 || fread(&len, sizeof(len), 1, r->f) != 1 ||
+			len > VIDEO_MAX || fread(in, 1, len, r->f) != len)
+		return 1;
+	if (type == VIDEO_KEY)
+		memset(r->frame, 0, sizeof(r->frame));
+	if (video_decode(in, len, r->frame))
+		return 1;
+	r->next++;
+	if (vram)
+		memcpy(vram, r->frame, sizeof(r->frame));
+	return 0;
+}
+
+// positions the reader so video_read() returns frame next, from the keyframe before it
+int
+video_seek(struct VideoReader *r, uint64_t frame) {
+	if (frame >= r->frames || r->nkeys == 0)
+		return 1;
+
+	int lo = 0;
+	int hi = r->nkeys - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (r->keys[mid].frame <= frame)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	if (r->next > frame || r->next < r->keys[lo].frame) {
+		fseek(r->f, r->keys[lo].offset, SEEK_SET);
+		r->next = r->keys[lo].frame;
+	}
+	while (r->next < frame) {
+		if (video_read(r, NULL))
+			return 1;
+	}
+	return 0;
+}
+
+void
+video_reader_close(struct VideoReader *r) {
+	if (r->f)
+		fclose(r->f);
+	free(r->keys);
+	r->f = NULL;
+	r->keys = NULL;
+}
@@ -0,0 +1,49 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#define VIDEO_VRAM 0x1c00 // 0x2400-0x3fff
+#define VIDEO_MAX (VIDEO_VRAM + VIDEO_VRAM / 128 + 1) // a frame of nothing but literals
+#define VIDEO_KEYFRAMES 600 // frames between keyframes, ten seconds
+
+enum VIDEO_FRAME {
+	VIDEO_KEY, // against a blank screen
+	VIDEO_DELTA, // against the frame before
+};
+
+struct VideoKey {
+	uint64_t frame;
+	uint64_t offset;
+};
+
+// recording: each frame the video ram xored with the last, run length coded
+struct Video {
+	FILE *f;
+	char path[1024];
+	uint8_t last[VIDEO_VRAM];
+	uint64_t frames;
+	uint64_t bytes;
+	struct VideoKey *keys;
+	uint32_t nkeys;
+	uint32_t cap;
+};
+
+struct VideoReader {
+	FILE *f;
+	uint8_t frame[VIDEO_VRAM];
+	uint64_t frames;
+	uint64_t next; // frame video_read() returns next
+	struct VideoKey *keys;
+	uint32_t nkeys;
+};
+
+size_t video_encode(const uint8_t *delta, uint8_t *out);
+int video_decode(const uint8_t *in, size_t len, uint8_t *frame);
+
+struct Video *video_open(const char *path);
+int video_frame(struct Video *v, const uint8_t *vram);
+int video_close(struct Video *v);
+
+int video_reader_open(struct VideoReader *r, const char *path);
+int video_read(struct VideoReader *r, uint8_t *vram);
+int video_seek(struct VideoReader *r, uint64_t frame);
+void video_reader_close(struct VideoReader *r);
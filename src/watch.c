@@ -0,0 +1,219 @@
+#define _GNU_SOURCE // REG_EFL
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__linux__) && defined(__x86_64__)
+#include <ucontext.h>
+#define WATCH_SUPPORTED
+#endif
+
+#include "cpu.h"
+#include "watch.h"
+
+#define PAGES (RAM_ALLOC / RAM_ALIGN)
+#define TRAP_FLAG 0x100
+
+static struct CPU *cpu;
+static struct {
+	uint16_t lo;
+	uint16_t hi; // inclusive
+} ranges[WATCH_MAX];
+static int nranges;
+static uint32_t watched; // a bit per page held read only
+static uint32_t opened; // watched pages let through for the instruction being stepped
+
+// filled by the handlers, drained by watch_report()
+static struct WatchHit hits[WATCH_HITS];
+static volatile uint64_t head;
+static uint64_t tail;
+
+static uint8_t *pending; // the store being stepped over
+static uint8_t pending_old;
+static uint16_t pending_pc;
+static uint8_t pending_interrupt;
+
+static struct sigaction old_segv;
+static struct sigaction old_trap;
+
+static int
+in_range(uint16_t adr) {
+	for (int i = 0; i < nranges; i++) {
+		if (adr >= ranges[i].lo && adr <= ranges[i].hi)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+protect(int page, int readonly) {
+	mprotect(cpu->ram + page * RAM_ALIGN, RAM_ALIGN, readonly ? PROT_READ : PROT_READ | PROT_WRITE);
+}
+
+// write protects exactly the pages a range touches
+static void
+update(void) {
+	uint32_t want = 0;
+	for (int i = 0; i < nranges; i++) {
+		for (int p = ranges[i].lo / RAM_ALIGN; p <= ranges[i].hi / RAM_ALIGN; p++)
+			want |= 1u << p;
+	}
+	for (int p = 0; p < PAGES; p++) {
+		if ((want ^ watched) >> p & 1)
+			protect(p, want >> p & 1);
+	}
+	watched = want;
+}
+
+#ifdef WATCH_SUPPORTED
+/*
+ * a store into a protected page: remember the old byte, open the page
+ * and single step the store. anything else goes to the old handler.
+ */
+static void
+segv(int sig, siginfo_t *si, void *context) {
+	ucontext_t *uc = context;
+	uint8_t *a = si->si_addr;
+	int page = cpu ? (a - cpu->ram) / RAM_ALIGN : -1;
+
+	if (cpu == NULL || a < cpu->ram || a >= cpu->ram + RAM_ALLOC || !(watched >> page & 1)) {
+		sigaction(SIGSEGV, &old_segv, NULL);
+		(void)sig;
+		return; // faults again, as it would have without us
+	}
+	if (pending == NULL) {
+		pending = a;
+		pending_old = *a;
+		// every store happens after the opcode fetch and before the operands
+		// are skipped, but for the push of an interrupt, which fetched nothing
+		pending_interrupt = cpu->interrupting;
+		pending_pc = pending_interrupt ? cpu->pc : cpu->pc - 1;
+	}
+	protect(page, 0);
+	opened |= 1u << page;
+	uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+// one host instruction after the store: record it and close the page again
+static void
+trap(int sig, siginfo_t *si, void *context) {
+	ucontext_t *uc = context;
+
+	if (pending == NULL) {
+		if (old_trap.sa_flags & SA_SIGINFO)
+			old_trap.sa_sigaction(sig, si, context);
+		else if (old_trap.sa_handler != SIG_IGN && old_trap.sa_handler != SIG_DFL)
+			old_trap.sa_handler(sig);
+		return;
+	}
+	uint16_t adr = pending - cpu->ram;
+	if (in_range(adr)) {
+		uint64_t h = head;
+		hits[h & (WATCH_HITS - 1)] = (struct WatchHit){ pending_pc, adr, pending_old, *pending, pending_interrupt };
+		head = h + 1;
+	}
+	for (int p = 0; p < PAGES; p++) {
+		if (opened >> p & 1)
+			protect(p, 1);
+	}
+	opened = 0;
+	pending = NULL;
+	uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+}
+#endif
+
+// watches cpu's ram from now on, nonzero where the platform can't
+int
+watch_open(struct CPU *c) {
+	if (cpu == c)
+		return 0;
+#ifdef WATCH_SUPPORTED
+	if (cpu) {
+		fprintf(stderr, "watchpoints are already on another cpu\n");
+		return 1;
+	}
+	if (sysconf(_SC_PAGESIZE) != RAM_ALIGN || ((uintptr_t)c->ram & (RAM_ALIGN - 1))) {
+		fprintf(stderr, "watchpoints need %d byte pages\n", RAM_ALIGN);
+		return 1;
+	}
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_sigaction = segv;
+	sigaction(SIGSEGV, &sa, &old_segv);
+	sa.sa_sigaction = trap;
+	sigaction(SIGTRAP, &sa, &old_trap);
+	cpu = c;
+	return 0;
+#else
+	(void)c;
+	fprintf(stderr, "watchpoints need x86_64 linux\n");
+	return 1;
+#endif
+}
+
+// unprotects everything and puts the old handlers back
+void
+watch_close(void) {
+	if (cpu == NULL)
+		return;
+	nranges = 0;
+	update();
+	sigaction(SIGSEGV, &old_segv, NULL);
+	sigaction(SIGTRAP, &old_trap, NULL);
+	cpu = NULL;
+}
+
+// watches lo to hi inclusive, nonzero if it is outside ram or there are too many
+int
+watch_add(uint16_t lo, uint16_t hi) {
+	if (cpu == NULL || nranges == WATCH_MAX || lo > hi || hi >= MEMORY_SIZE)
+		return 1;
+	ranges[nranges].lo = lo;
+	ranges[nranges].hi = hi;
+	nranges++;
+	update();
+	return 0;
+}
+
+// drops every range holding adr, nonzero if there was none
+int
+watch_remove(uint16_t adr) {
+	int n = 0;
+	for (int i = 0; i < nranges; i++) {
+		if (adr < ranges[i].lo || adr > ranges[i].hi)
+			ranges[n++] = ranges[i];
+	}
+	int removed = n != nranges;
+	nranges = n;
+	update();
+	return !removed;
+}
+
+void
+watch_list(FILE *out) {
+	for (int i = 0; i < nranges; i++)
+		fprintf(out, "%s%04x-%04x", i ? " " : "", ranges[i].lo, ranges[i].hi);
+	fprintf(out, nranges ? "\n" : "no watchpoints\n");
+}
+
+// prints the hits since the last call, returns how many
+int
+watch_report(FILE *out) {
+	uint64_t h = head;
+	int n = h - tail;
+
+	if (h - tail > WATCH_HITS) {
+		fprintf(out, "watch: %llu writes lost\n", (unsigned long long)(h - tail - WATCH_HITS));
+		tail = h - WATCH_HITS;
+	}
+	for (; tail != h; tail++) {
+		const struct WatchHit *w = &hits[tail & (WATCH_HITS - 1)];
+		fprintf(out, "watch: %04x %s %04x: %02x -> %02x\n", w->pc,
+			w->interrupt ? "interrupted, pushed to" : "wrote", w->adr, w->old, w->new);
+	}
+	return n;
+}
@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#define WATCH_MAX 16 // ranges
+#define WATCH_HITS 1024 // kept until watch_report(), a power of two
+
+// a write to a watched address, by the instruction at pc or an interrupt taken before it
+struct WatchHit {
+	uint16_t pc;
+	uint16_t adr;
+	uint8_t old;
+	uint8_t new;
+	uint8_t interrupt; // generate_interrupt() pushing pc
+};
+
+/*
+ * data watchpoints on one cpu's ram, x86_64 linux only. the host pages
+ * holding watched addresses are made read only, a write faults, and the
+ * handler lets that one store through with the trap flag set before
+ * protecting the page again. nothing else pays anything.
+ */
+int watch_open(struct CPU *cpu);
+void watch_close(void);
+int watch_add(uint16_t lo, uint16_t hi);
+int watch_remove(uint16_t adr);
+void watch_list(FILE *out);
+int watch_report(FILE *out);
@@ -0,0 +1,290 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/cpu.h"
+
+#define HL 0x2000 // where M points
+#define REPORT 8 // mismatches printed per opcode
+
+static const char *variants[] = { "plain", "traced", "profiled", "debug", "coverage", "dirty" };
+// these count into global arrays without atomics, so they run on one thread
+static const char *serial[] = { "profiled", "coverage" };
+
+// one opcode run through one variant
+struct Job {
+	emulate_fn fn;
+	const char *variant;
+	uint8_t op;
+};
+
+static struct Job jobs[sizeof(variants) / sizeof(variants[0]) * 256];
+static int njobs;
+static int nparallel; // jobs before this the worker threads share
+static int next_job;
+static uint64_t cases;
+static uint64_t mismatches;
+
+struct Result {
+	uint8_t a;
+	uint8_t r; // the INR/DCR register, or the ALU operand
+	uint8_t psw;
+};
+
+// s z 0 ac 0 p 1 c
+static uint8_t
+psw(uint8_t res, int ac, int c) {
+	int p = 1;
+	for (int i = 0; i < 8; i++)
+		p ^= (res >> i) & 1;
+	return (res & 0x80) | (res == 0) << 6 | ac << 4 | p << 2 | 0x02 | c;
+}
+
+/*
+ * the reference model, written from the data sheet rather than from the
+ * core: subtraction is addition of the complement and aux carry is the
+ * carry into bit 4, taken from the xor of the operands and the sum.
+ */
+static struct Result
+model(uint8_t op, uint8_t a, uint8_t v, uint8_t in) {
+	struct Result r = { a, v, in };
+	int c = in & CARRY;
+	int ac = (in & AUX) != 0;
+
+	if ((op & 0xc0) == 0x80 || (op & 0xc7) == 0xc6) {
+		int g = (op >> 3) & 7;
+		unsigned sum;
+		uint8_t res;
+		switch (g) {
+			case 0: case 1: // ADD ADC
+				sum = a + v + (g == 1 ? c : 0);
+				res = sum;
+				r.a = res;
+				r.psw = psw(res, ((a ^ v ^ sum) & 0x10) != 0, sum > 0xff);
+				break;
+			case 2: case 3: case 7: // SUB SBB CMP
+				sum = a + (uint8_t)~v + !(g == 3 ? c : 0);
+				res = sum;
+				r.a = g == 7 ? a : res;
+				r.psw = psw(res, ((a ^ (uint8_t)~v ^ sum) & 0x10) != 0, !(sum >> 8));
+				break;
+			case 4: // ANA
+				r.a = a & v;
+				r.psw = psw(r.a, ((a | v) >> 3) & 1, 0);
+				break;
+			case 5: // XRA
+				r.a = a ^ v;
+				r.psw = psw(r.a, 0, 0);
+				break;
+			case 6: // ORA
+				r.a = a | v;
+				r.psw = psw(r.a, 0, 0);
+				break;
+		}
+		return r;
+	}
+
+	if ((op & 0xc6) == 0x04) { // INR DCR
+		uint8_t res = op & 1 ? v - 1 : v + 1;
+		r.r = res;
+		if (((op >> 3) & 7) == 7)
+			r.a = res;
+		int half = op & 1 ? (v & 0xf) != 0 : (v & 0xf) == 0xf;
+		r.psw = psw(res, half, c);
+		return r;
+	}
+
+	switch (op) {
+		case 0x27: // DAA, in two steps as the data sheet has it
+		{
+			unsigned res = a;
+			int half = 0;
+			if ((res & 0xf) > 9 || ac) {
+				half = (res & 0xf) + 6 > 0xf;
+				res += 6;
+			}
+			if ((res >> 4) > 9 || c) {
+				res += 0x60;
+				c = 1;
+			}
+			r.a = res;
+			r.psw = psw(r.a, half, c);
+			break;
+		}
+		case 0x07: // RLC
+			r.a = a << 1 | a >> 7;
+			r.psw = (in & ~CARRY) | a >> 7;
+			break;
+		case 0x0f: // RRC
+			r.a = a >> 1 | a << 7;
+			r.psw = (in & ~CARRY) | (a & 1);
+			break;
+		case 0x17: // RAL
+			r.a = a << 1 | c;
+			r.psw = (in & ~CARRY) | a >> 7;
+			break;
+		case 0x1f: // RAR
+			r.a = a >> 1 | c << 7;
+			r.psw = (in & ~CARRY) | (a & 1);
+			break;
+		case 0x2f: // CMA
+			r.a = ~a;
+			break;
+		case 0x37: // STC
+			r.psw = in | CARRY;
+			break;
+		case 0x3f: // CMC
+			r.psw = in ^ CARRY;
+			break;
+	}
+	return r;
+}
+
+static int
+alu(uint8_t op) {
+	return (op & 0xc0) == 0x80 || (op & 0xc7) == 0xc6 || (op & 0xc6) == 0x04 ||
+		op == 0x27 || op == 0x07 || op == 0x0f || op == 0x17 || op == 0x1f ||
+		op == 0x2f || op == 0x37 || op == 0x3f;
+}
+
+// the register the operand is in: 0-7 as in the opcode, -1 for immediates
+static int
+source(uint8_t op) {
+	if ((op & 0xc0) == 0x80)
+		return op & 7;
+	if ((op & 0xc6) == 0x04)
+		return (op >> 3) & 7;
+	return -1;
+}
+
+static uint8_t *
+reg(struct CPU *cpu, int r) {
+	uint8_t *regs[] = { &cpu->b, &cpu->c, &cpu->d, &cpu->e, &cpu->h, &cpu->l, &cpu->ram[HL], &cpu->a };
+	return regs[r];
+}
+
+// every a, operand and carry in, with the other flags taken from the operand
+static void
+check(struct Job *job, uint8_t *ram) {
+	struct CPU cpu;
+	int r = source(job->op);
+	int bad = 0;
+	uint64_t n = 0;
+
+	for (int a = 0; a < 256; a++) {
+		for (int v = 0; v < 256; v++) {
+			if (r == 7 && v != a)
+				continue; // the operand is a itself
+			for (int c = 0; c < 2; c++) {
+				uint8_t in = (v << 2 & (SIGN | ZERO | AUX | PARITY)) | 0x02 | c;
+
+				memset(&cpu, 0, sizeof(cpu));
+				cpu.ram = ram;
+				cpu.a = a;
+				cpu.b = 0x12; cpu.c = 0x34; cpu.d = 0x56; cpu.e = 0x78;
+				cpu.h = HL >> 8; cpu.l = HL & 0xff;
+				cpu.sp = 0xf000;
+				cpu.flags.s = (in & SIGN) != 0;
+				cpu.flags.z = (in & ZERO) != 0;
+				cpu.flags.a = (in & AUX) != 0;
+				cpu.flags.p = (in & PARITY) != 0;
+				cpu.flags.c = c;
+				ram[0] = job->op;
+				ram[1] = v;
+				ram[HL] = 0x9a;
+				if (r >= 0)
+					*reg(&cpu, r) = v;
+
+				struct Result want = model(job->op, a, v, in);
+				if (r == 7)
+					want.r = want.a;
+
+				job->fn(&cpu);
+				n++;
+
+				struct Result got = { cpu.a, r >= 0 ? *reg(&cpu, r) : v, get_psw(&cpu.flags) };
+				if (got.a == want.a && got.r == want.r && got.psw == want.psw)
+					continue;
+				if (bad++ < REPORT)
+					printf("%s %02x a=%02x v=%02x f=%02x: got a=%02x r=%02x f=%02x, want a=%02x r=%02x f=%02x\n",
+						job->variant, job->op, a, v, in,
+						got.a, got.r, got.psw, want.a, want.r, want.psw);
+			}
+		}
+	}
+	__atomic_fetch_add(&cases, n, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&mismatches, bad, __ATOMIC_RELAXED);
+}
+
+static void *
+worker(void *arg) {
+	(void)arg;
+	uint8_t *ram = calloc(0x10000, 1);
+	int i;
+	while ((i = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED)) < nparallel)
+		check(&jobs[i], ram);
+	free(ram);
+	return NULL;
+}
+
+static int
+is_serial(const char *variant) {
+	for (size_t i = 0; i < sizeof(serial) / sizeof(serial[0]); i++) {
+		if (strcmp(serial[i], variant) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * checks every ALU opcode of every emulate() variant against the model
+ * for each accumulator, operand and carry in, spread over all cores but
+ * for the serial variants, which the main thread runs afterwards.
+ */
+int
+main(void) {
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+			if (is_serial(variants[v]) != pass)
+				continue;
+			for (int op = 0; op < 256; op++) {
+				if (!alu(op))
+					continue;
+				jobs[njobs].fn = emulate_variant(variants[v]);
+				jobs[njobs].variant = variants[v];
+				jobs[njobs].op = op;
+				njobs++;
+			}
+		}
+		if (pass == 0)
+			nparallel = njobs;
+	}
+
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	pthread_t *tid = malloc(threads * sizeof(*tid));
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (long i = 0; i < threads; i++)
+		pthread_create(&tid[i], NULL, worker, NULL);
+	for (long i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+	uint8_t *ram = calloc(0x10000, 1);
+	for (int i = nparallel; i < njobs; i++)
+		check(&jobs[i], ram);
+	free(ram);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+	printf("%d opcode/variant pairs, %llu cases, %llu mismatches, %.0f ms on %ld threads\n",
+		njobs, (unsigned long long)cases, (unsigned long long)mismatches, ms, threads);
+	free(tid);
+	return mismatches != 0;
+}
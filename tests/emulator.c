@@ -1,41 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "../src/cpu.h"
-#include "../src/dissasemble.h"
+#include "../src/cpm.h"
+#include "../src/trace.h"
+
+#define LIMIT 10000000 // instructions, cpudiag needs a few hundred
 
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-g golden] [-w golden] [-n interval] [-t trace] [program]\n", name);
+	exit(1);
+}
+
+// 64 bit fnv-1a over the registers, psw included
+static uint64_t
+state_hash(struct CPU *cpu) {
+	uint8_t regs[] = {
+		cpu->a, get_psw(&cpu->flags), cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l,
+		cpu->sp >> 8, cpu->sp & 0xff, cpu->pc >> 8, cpu->pc & 0xff, cpu->interrupts,
+	};
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < sizeof(regs); i++) {
+		hash ^= regs[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+/*
+ * runs cpudiag.bin under the minimal cp/m of cpm.c and passes if it
+ * reports the cpu operational. -w writes the state hash every -n
+ * instructions to a golden file, -g checks a run against one at the
+ * interval it was written with and names the first window where the
+ * core diverged. a failing run writes no golden file, so one can only be
+ * recorded from a core cpudiag passes.
+ */
 int
-main(void) {
-	struct CPU cpu = {0};
-	FILE *f = fopen("cpudiag.bin", "r");
-	if (f == NULL) {
-		perror("failed to open rom");
-		return 1;
+main(int argc, char **argv) {
+	char *program = "cpudiag.bin";
+	char *golden = NULL;
+	char *write = NULL;
+	char *trace = NULL;
+	long interval = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "g:w:n:t:")) != -1) {
+		switch (opt) {
+			case 'g': golden = optarg; break;
+			case 'w': write = optarg; break;
+			case 'n': interval = atol(optarg); break;
+			case 't': trace = optarg; break;
+			default: usage(argv[0]);
+		}
 	}
+	if (optind < argc)
+		program = argv[optind];
+	if (interval < 1)
+		usage(argv[0]);
 
-	fseek(f, 0, SEEK_END);
-	int len = ftell(f);
-	fseek(f, 0, SEEK_SET);
-	/*cpu.ram = calloc(len + 0x100, sizeof(uint8_t));*/
-	cpu.ram = calloc(0xffff, 1);
+	struct CPM cpm;
+	if (cpm_init(&cpm, program))
+		return 1;
+	cpm.image[368] = 0x7; // stack at 0x7ad
 
-	fread(&cpu.ram[0x100], sizeof(uint8_t), len, f);
-	fclose(f);
+	FILE *g = NULL;
+	if (golden) {
+		if ((g = fopen(golden, "r")) == NULL) {
+			perror(golden);
+			return 1;
+		}
+		if (fscanf(g, "interval %ld", &interval) != 1 || interval < 1) {
+			fprintf(stderr, "%s: not a golden trace\n", golden);
+			return 1;
+		}
+	}
+	// written next to the golden file and renamed over it on a pass
+	char tmp[1024];
+	FILE *w = NULL;
+	if (write) {
+		snprintf(tmp, sizeof(tmp), "%s.tmp", write);
+		if ((w = fopen(tmp, "w")) == NULL) {
+			perror(tmp);
+			return 1;
+		}
+		fprintf(w, "interval %ld\n", interval);
+	}
+	struct Tracer *t = NULL;
+	if (trace) {
+		if ((t = trace_open(trace)) == NULL)
+			return 1;
+		cpm.emulate = emulate_traced;
+	}
+	cpm_restart(&cpm);
 
-	/*cpu.ram[0] = 0xc3;*/
-	/*cpu.ram[1] = 0;*/
-	/*cpu.ram[2] = 0x01;*/
-	cpu.pc = 0x100;
+	long n = 0;
+	long diverged = -1;
+	while (!cpm.done && n < LIMIT) {
+		cpm_step(&cpm);
+		if (++n % interval)
+			continue;
 
-	cpu.ram[368] = 0x7;
+		uint64_t hash = state_hash(&cpm.cpu);
+		if (w)
+			fprintf(w, "%ld %016llx\n", n, (unsigned long long)hash);
+		if (g && diverged < 0) {
+			long at;
+			unsigned long long want;
+			if (fscanf(g, "%ld %llx", &at, &want) != 2 || at != n || want != hash)
+				diverged = n;
+		}
+	}
+	// a golden run that went on longer than this one
+	if (g && diverged < 0 && !feof(g)) {
+		long at;
+		unsigned long long want;
+		if (fscanf(g, "%ld %llx", &at, &want) == 2)
+			diverged = n;
+	}
 
-	cpu.ram[0x59c] = 0xc3;
-	cpu.ram[0x59d] = 0xc2;
-	cpu.ram[0x59e] = 0x05;
+	trace_close(t);
+	if (g)
+		fclose(g);
 
-	printf("starting tests\n");
-	while (1) {
-		get_opname(cpu.ram, cpu.pc);
-		emulate(&cpu);
-		print_cpu_state(&cpu, 0);
+	int pass = cpm.done && strstr(cpm.out, "CPU IS OPERATIONAL") != NULL;
+	if (w) {
+		fclose(w);
+		if (!pass) {
+			fprintf(stderr, "%s: not recording a golden file from a failing run\n", write);
+			remove(tmp);
+		} else if (rename(tmp, write)) {
+			perror(write);
+			return 1;
+		}
 	}
+	printf("%s: %ld instructions, %s\n", program, n, cpm.done ? "exited" : "did not exit");
+	printf("output: %s\n", cpm.out);
+	if (g) {
+		if (diverged < 0)
+			printf("golden: matches %s\n", golden);
+		else
+			printf("golden: diverged from %s within instructions %ld-%ld\n",
+				golden, diverged - interval + 1, diverged);
+	}
+	printf("%s\n", pass ? "PASS" : "FAIL");
+
+	cpm_free(&cpm);
+	return !pass || diverged >= 0;
 }
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/cpu.h"
+#include "../src/machine.h"
+#include "../src/lockstep.h"
+#include "../src/invaders.h"
+#include "../src/ram.h"
+
+#define ENVS (LANES + 3) // one full group and a short one
+#define STEPS 3000
+#define FRAMESKIP 4
+
+static int
+same(struct CPU *x, struct CPU *y) {
+	return x->a == y->a && x->b == y->b && x->c == y->c && x->d == y->d &&
+		x->e == y->e && x->h == y->h && x->l == y->l &&
+		x->sp == y->sp && x->pc == y->pc && x->interrupts == y->interrupts &&
+		x->flags.z == y->flags.z && x->flags.s == y->flags.s &&
+		x->flags.p == y->flags.p && x->flags.a == y->flags.a && x->flags.c == y->flags.c &&
+		memcmp(x->ram, y->ram, MEMORY_SIZE) == 0;
+}
+
+/*
+ * steps the same cabinets with the same actions through invaders_step()
+ * and invaders_step_batch(), and checks that the two agree after every
+ * step. some games are ended early by clearing the game mode, so lanes
+ * leave their group at different frames.
+ */
+int
+main(int argc, char **argv) {
+	static struct Invaders seq[ENVS], batch[ENVS];
+	static uint8_t seq_obs[ENVS * VRAM_SIZE], batch_obs[ENVS * VRAM_SIZE];
+	struct Step seq_steps[ENVS], batch_steps[ENVS];
+	enum ACTION actions[ENVS];
+	int ended = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s rom\n", argv[0]);
+		return 1;
+	}
+
+	for (int i = 0; i < ENVS; i++) {
+		if (invaders_init(&seq[i], argv[1], OBS_VRAM) || invaders_init(&batch[i], argv[1], OBS_VRAM)
+			|| invaders_reset(&seq[i], NULL) || invaders_reset(&batch[i], NULL)) {
+			fprintf(stderr, "can't start %s\n", argv[1]);
+			return 1;
+		}
+	}
+
+	srand(1);
+	for (int t = 0; t < STEPS; t++) {
+		for (int i = 0; i < ENVS; i++) {
+			actions[i] = rand() % ACTIONS;
+			if (t == 100 + 7 * i && i % 3 == 0) {
+				seq[i].machine.cpu->ram[GAME_MODE] = 0;
+				batch[i].machine.cpu->ram[GAME_MODE] = 0;
+			}
+		}
+
+		invaders_step_batch(batch, ENVS, actions, FRAMESKIP, batch_obs, batch_steps);
+		for (int i = 0; i < ENVS; i++)
+			invaders_step(&seq[i], actions[i], FRAMESKIP, seq_obs + i * VRAM_SIZE, &seq_steps[i]);
+
+		for (int i = 0; i < ENVS; i++) {
+			if (!same(seq[i].machine.cpu, batch[i].machine.cpu)
+				|| memcmp(&seq_steps[i], &batch_steps[i], sizeof(struct Step))
+				|| memcmp(seq_obs + i * VRAM_SIZE, batch_obs + i * VRAM_SIZE, VRAM_SIZE)) {
+				printf("env %d differs after step %d\n", i, t);
+				return 1;
+			}
+			ended += seq_steps[i].done;
+		}
+	}
+
+	for (int i = 0; i < ENVS; i++) {
+		invaders_free(&seq[i]);
+		invaders_free(&batch[i]);
+	}
+	printf("%d environments, %d steps, %d done steps, batch matches sequential\n", ENVS, STEPS, ended);
+	return 0;
+}
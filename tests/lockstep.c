@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/cpu.h"
+#include "../src/lockstep.h"
+
+#define ROUNDS 2000
+#define CYCLES 1000
+
+static int
+same(struct CPU *x, struct CPU *y) {
+	return x->a == y->a && x->b == y->b && x->c == y->c && x->d == y->d &&
+		x->e == y->e && x->h == y->h && x->l == y->l &&
+		x->sp == y->sp && x->pc == y->pc &&
+		x->flags.z == y->flags.z && x->flags.s == y->flags.s &&
+		x->flags.p == y->flags.p && x->flags.a == y->flags.a && x->flags.c == y->flags.c &&
+		memcmp(x->ram, y->ram, 0x10000) == 0;
+}
+
+/*
+ * every lane runs cpudiag after spinning in a counting loop of its own
+ * length, so lanes split on the loop exit and have to merge again. each
+ * lane is checked against a plain emulate() run after every round.
+ */
+int
+main(void) {
+	struct CPU lanes[LANES] = {0};
+	struct CPU refs[LANES] = {0};
+	struct CPU *cpus[LANES];
+	struct Lockstep ls;
+
+	FILE *f = fopen("cpudiag.bin", "r");
+	if (f == NULL) {
+		perror("failed to open rom");
+		return 1;
+	}
+
+	uint8_t *rom = calloc(0x10000, 1);
+	fread(&rom[0x100], sizeof(uint8_t), 0x10000 - 0x100, f);
+	fclose(f);
+	rom[368] = 0x7;
+
+	for (int i = 0; i < LANES; i++) {
+		uint8_t prologue[] = {
+			0x06, 1 + 3 * i, // MVI B,n
+			0x05,            // DCR B
+			0xc2, 0x82, 0x00, // JNZ $0082
+			0xc3, 0x00, 0x01, // JMP $0100
+		};
+
+		lanes[i].ram = malloc(0x10000);
+		memcpy(lanes[i].ram, rom, 0x10000);
+		memcpy(&lanes[i].ram[0x80], prologue, sizeof(prologue));
+		lanes[i].pc = 0x80;
+
+		refs[i] = lanes[i];
+		refs[i].ram = malloc(0x10000);
+		memcpy(refs[i].ram, lanes[i].ram, 0x10000);
+
+		cpus[i] = &lanes[i];
+	}
+
+	if (lockstep_init(&ls, cpus, LANES))
+		return 1;
+
+	for (int round = 0; round < ROUNDS; round++) {
+		lockstep_run(&ls, CYCLES);
+		lockstep_store(&ls);
+
+		for (int i = 0; i < LANES; i++) {
+			for (int cycles = 0; cycles < CYCLES;)
+				cycles += emulate(&refs[i]);
+
+			if (!same(&lanes[i], &refs[i])) {
+				printf("lane %d diverged from emulate() in round %d\n", i, round);
+				print_cpu_state(&lanes[i], 0);
+				print_cpu_state(&refs[i], 0);
+				return 1;
+			}
+		}
+	}
+
+	printf("%d lanes, %llu instructions, %.2f lanes/dispatch, %.1f%% vectorised\n",
+		LANES, (unsigned long long)ls.steps,
+		(double)ls.steps / ls.groups, 100.0 * ls.vector / ls.steps);
+	return 0;
+}
@@ -0,0 +1,59 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/analyse.h"
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-d] [-f] rom\n", name);
+	exit(1);
+}
+
+/*
+ * prints the basic blocks, edges, call targets and data regions of a rom,
+ * or with -d its block graph for graphviz. the analysis is cached per
+ * rom, -f redoes it.
+ */
+int
+main(int argc, char **argv) {
+	int dot = 0;
+	int fresh = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "df")) != -1) {
+		switch (opt) {
+			case 'd': dot = 1; break;
+			case 'f': fresh = 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0]);
+
+	uint8_t *rom = calloc(ROM_SIZE + 2, 1);
+	FILE *f = fopen(argv[optind], "rb");
+	if (f == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+	fread(rom, 1, ROM_SIZE, f);
+	fclose(f);
+
+	struct Analysis *an = malloc(sizeof(*an));
+	if (fresh)
+		analyse(an, rom);
+	else
+		analyse_cached(an, rom);
+
+	if (dot)
+		analysis_dot(an, stdout);
+	else
+		analysis_text(an, rom, stdout);
+
+	free(an);
+	free(rom);
+	return 0;
+}
@@ -0,0 +1,62 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/analyse.h"
+#include "../src/coverage.h"
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-o merged] [-r rom] coverage...\n", name);
+	exit(1);
+}
+
+/*
+ * merges coverage files written by headless -C into -o, and with -r
+ * reports which of that rom's code none of them executed.
+ */
+int
+main(int argc, char **argv) {
+	char *output = NULL;
+	char *romfile = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:r:")) != -1) {
+		switch (opt) {
+			case 'o': output = optarg; break;
+			case 'r': romfile = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc || (output == NULL && romfile == NULL))
+		usage(argv[0]);
+
+	uint8_t bits[COVERAGE_SIZE] = {0};
+	for (int i = optind; i < argc; i++) {
+		if (coverage_load(bits, argv[i]))
+			return 1;
+	}
+	if (output && coverage_merge(bits, output))
+		return 1;
+	if (romfile == NULL)
+		return 0;
+
+	uint8_t *rom = calloc(ROM_SIZE + 2, 1);
+	FILE *f = fopen(romfile, "rb");
+	if (f == NULL) {
+		perror(romfile);
+		return 1;
+	}
+	fread(rom, 1, ROM_SIZE, f);
+	fclose(f);
+
+	struct Analysis *an = malloc(sizeof(*an));
+	analyse_cached(an, rom);
+	coverage_report(bits, rom, an, stdout);
+
+	free(an);
+	free(rom);
+	return 0;
+}
@@ -0,0 +1,52 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/cpu.h"
+#include "../src/trace.h"
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-s skip] [-n count] trace\n", name);
+	exit(1);
+}
+
+/*
+ * renders a binary trace in the text format the traced core used to
+ * print, from record -s on and at most -n of them.
+ */
+int
+main(int argc, char **argv) {
+	uint64_t skip = 0;
+	uint64_t count = UINT64_MAX;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+		switch (opt) {
+			case 's': skip = strtoull(optarg, NULL, 0); break;
+			case 'n': count = strtoull(optarg, NULL, 0); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0]);
+
+	FILE *f = trace_reader(argv[optind]);
+	if (f == NULL)
+		return 1;
+
+	struct Record rec;
+	struct Record last = {0};
+	for (uint64_t i = 0; trace_read(f, &rec, &last) == 0; i++) {
+		if (i < skip)
+			continue;
+		if (i - skip >= count)
+			break;
+		trace_print(&rec);
+	}
+
+	fclose(f);
+	return 0;
+}
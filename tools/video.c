@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/clock.h"
+#include "../src/video.h"
+#include "../src/capture.h"
+
+static void
+usage(char *name) {
+	fprintf(stderr, "usage: %s [-s first] [-n count] [-o out] recording\n", name);
+	exit(1);
+}
+
+/*
+ * decodes a recording made with headless -o file.siv and prints its
+ * size and decoding speed, or with -o writes the frames out as pngs,
+ * y4m or raw the way headless -o would have. -s seeks to a frame first.
+ */
+int
+main(int argc, char **argv) {
+	uint64_t first = 0;
+	uint64_t count = UINT64_MAX;
+	char *output = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:n:o:")) != -1) {
+		switch (opt) {
+			case 's': first = strtoull(optarg, NULL, 10); break;
+			case 'n': count = strtoull(optarg, NULL, 10); break;
+			case 'o': output = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0]);
+
+	struct VideoReader r;
+	if (video_reader_open(&r, argv[optind]))
+		return 1;
+	if (first && video_seek(&r, first)) {
+		fprintf(stderr, "%s: has %llu frames\n", argv[optind], (unsigned long long)r.frames);
+		return 1;
+	}
+
+	struct Capture *cap = NULL;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (output && (cap = capture_open(output, capture_format(output), CAPTURE_BLOCK, 64, cpus > 1 ? cpus - 1 : 1)) == NULL)
+		return 1;
+
+	uint8_t vram[VIDEO_VRAM];
+	uint64_t n = 0;
+	uint64_t start = clock_ns();
+	for (; n < count && video_read(&r, vram) == 0; n++) {
+		if (cap)
+			capture_frame(cap, vram);
+	}
+	uint64_t took = clock_ns() - start;
+	int failed = capture_close(cap);
+
+	struct stat st;
+	stat(argv[optind], &st);
+	printf("%llu frames (%.1f minutes), %d keyframes, %lld bytes, %.1f bytes/frame\n",
+		(unsigned long long)r.frames, r.frames / 3600.0, r.nkeys, (long long)st.st_size,
+		r.frames ? (double)st.st_size / r.frames : 0.0);
+	printf("decoded %llu from frame %llu in %.1f ms, %.0f frames/s (%.0fx real time)\n",
+		(unsigned long long)n, (unsigned long long)first, took / 1e6,
+		took ? n / (took / 1e9) : 0.0, took ? n / (took / 1e9) / 60 : 0.0);
+
+	video_reader_close(&r);
+	return failed;
+}